@@ -0,0 +1,134 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "extfs.h"
+
+#define GZIP_INDEX_SPAN (1024 * 1024)
+
+static int open_image(struct Backend* backend, const char* file_name) {
+    if (open_android_sparse_backend(backend, file_name) || open_qcow2_backend(backend, file_name) || open_zstd_seekable_backend(backend, file_name)) {
+        return 1;
+    }
+
+    char index_file_name[FILE_PATH_SIZE];
+    snprintf(index_file_name, FILE_PATH_SIZE, "%s.idx", file_name);
+
+    if (access(index_file_name, R_OK) == 0 && open_gzip_indexed_backend(backend, file_name, index_file_name)) {
+        return 1;
+    }
+
+    return open_file_backend(backend, file_name);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "-i") == 0) {
+        char index_file_name[FILE_PATH_SIZE];
+        snprintf(index_file_name, FILE_PATH_SIZE, "%s.idx", argv[2]);
+
+        if (!build_gzip_index(argv[2], index_file_name, GZIP_INDEX_SPAN)) {
+            printf("Can't build index %s\n", index_file_name);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    if (argc != 3) {
+        printf("%s <image file> <file path>\n", argv[0]);
+        printf("%s -i <gzip image file>    builds <gzip image file>.idx\n", argv[0]);
+        printf("Raw, Android sparse, qcow2, seekable zstd and gzip images with an index are supported\n");
+        exit(0);
+    }
+
+    struct Backend backend;
+
+    if (!open_image(&backend, argv[1])) {
+        perror("Can't open file");
+        exit(1);
+    }
+
+    set_backend(&backend);
+
+    struct Partition first_partition_info;
+    if (!parse_partition(&first_partition_info, 0))  {
+        printf("MBR corrupt or partition not used\n");
+        return 1;
+    }
+
+    __g_partition_offset = (disk_offset_t) first_partition_info.start_sector * SECTOR_SIZE;
+
+    struct Superblock sblock;
+    if (!parse_superblock(&sblock, 0))  {
+        printf("superblock corrupt\n");
+        return 1;
+    }
+
+    unsigned int file_inode_nr;
+    struct Inode inode;
+
+    if (!get_inode_for_path(&sblock, argv[2], &file_inode_nr) || !parse_inode(&sblock, &inode, file_inode_nr)) {
+        printf("File not found\n");
+        return 1;
+    }
+
+    uint8_t* buffer = malloc(sblock.block_size);
+
+    for (unsigned int db_nr = 0; (uint64_t) db_nr * sblock.block_size < inode.size; db_nr++) {
+        const unsigned int left = inode.size - (db_nr * sblock.block_size);
+        const unsigned int length = (left < sblock.block_size) ? left : sblock.block_size;
+
+        unsigned int db_block_nr = 0;
+        const int mapped = get_inode_data_block(&sblock, &inode, db_nr, &db_block_nr);
+
+        if (mapped < 0) {
+            fprintf(stderr, "Block map can't be walked\n");
+            break;
+        }
+
+        if (mapped) {
+            read_partition_bytes((disk_offset_t) db_block_nr * sblock.block_size, buffer, length);
+        }
+        else { // Hole
+            memset(buffer, 0, length);
+        }
+
+        fwrite(buffer, 1, length, stdout);
+    }
+
+    free(buffer);
+
+    close_backend(&backend);
+
+    return 0;
+}
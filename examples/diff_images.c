@@ -0,0 +1,669 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "extfs.h"
+
+// Equal bytes between two changes below this are reported as a single changed range
+#define RANGE_MERGE_GAP 16
+
+struct Image {
+    const char* file_name;
+
+    const void* map;
+    size_t size;
+    const void* partition;
+
+    struct Superblock sblock;
+};
+
+struct Diff {
+    struct Image* a;
+    struct Image* b;
+
+    uint8_t* dirty_blocks; // Bitmap of blocks whose content differs between both images
+    uint8_t* dirty_inodes; // Bitmap of inodes whose raw inode differs between both images
+    unsigned int next_bg; // Next block group to be claimed by a worker
+
+    const uint8_t* zero_block; // Holes
+
+    unsigned int added;
+    unsigned int removed;
+    unsigned int modified;
+    unsigned int uncompared; // Files whose content can't be compared completely
+};
+
+struct Entry {
+    char name[FILE_PATH_SIZE];
+    unsigned int inode_nr;
+};
+
+static void select_image(struct Image* image) {
+    __g_disk_buffer_start = image->map;
+    __g_partition_buffer_start = image->partition;
+}
+
+static int open_image(struct Image* image, const char* file_name) {
+    image->file_name = file_name;
+
+    int fd = open(file_name, O_RDONLY);
+
+    if (fd == -1) {
+        perror("Can't open file");
+        return 0;
+    }
+
+    struct stat img_stat_info;
+
+    if (fstat(fd, &img_stat_info) == -1) {
+        perror("Can't stat file");
+        close(fd);
+        return 0;
+    }
+
+    image->size = img_stat_info.st_size;
+    image->map = mmap(NULL, image->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (image->map == MAP_FAILED) {
+        perror("Can't map file");
+        return 0;
+    }
+
+    __g_disk_buffer_start = image->map;
+
+    struct Partition first_partition_info;
+    if (!parse_partition(&first_partition_info, 0))  {
+        printf("%s: MBR corrupt or partition not used\n", file_name);
+        return 0;
+    }
+
+    if ((size_t) first_partition_info.start_sector * SECTOR_SIZE + 2048 > image->size) {
+        printf("%s: image truncated\n", file_name);
+        return 0;
+    }
+
+    image->partition = image->map + (size_t) first_partition_info.start_sector * SECTOR_SIZE;
+
+    select_image(image);
+
+    // Only the sectors present in the image count, so nothing past the end of a truncated image is read
+    const size_t image_sectors = (image->size / SECTOR_SIZE) - first_partition_info.start_sector;
+    const unsigned int partition_sectors = (image_sectors < first_partition_info.total_sectors) ? image_sectors : first_partition_info.total_sectors;
+
+    struct MountState mount_state;
+
+    if (!mount_extfs(&image->sblock, &mount_state, partition_sectors))  {
+        printf("%s: superblock corrupt or image truncated\n", file_name);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Returns NULL for blocks past the end of the file system or a truncated image
+static const uint8_t* get_block(struct Image* image, unsigned int block_nr) {
+    const size_t partition_size = image->size - (image->partition - image->map);
+    const size_t offset = (size_t) block_nr * image->sblock.block_size;
+
+    if (block_nr >= image->sblock.block_count || offset + image->sblock.block_size > partition_size) {
+        return NULL;
+    }
+
+    return image->partition + offset;
+}
+
+static const uint8_t* get_raw_inode(struct Image* image, unsigned int inode_nr) {
+    struct Superblock* sblock = &image->sblock;
+    struct Blockgroup bg;
+
+    select_image(image);
+    parse_bg_descriptor(sblock, &bg, (inode_nr - 1) / sblock->inodes_per_group);
+
+    const unsigned int inode_offset = ((inode_nr - 1) % sblock->inodes_per_group) * sblock->inode_size;
+    const uint8_t* block = get_block(image, bg.inode_table_block_nr + (inode_offset / sblock->block_size));
+
+    return block ? block + (inode_offset % sblock->block_size) : NULL;
+}
+
+static uint32_t le16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static int is_block_dirty(struct Diff* diff, unsigned int block_nr) {
+    return diff->dirty_blocks[block_nr / 8] & (1 << (block_nr % 8));
+}
+
+static int is_dirty(struct Diff* diff, unsigned int inode_nr) {
+    return diff->dirty_inodes[(inode_nr - 1) / 8] & (1 << ((inode_nr - 1) % 8));
+}
+
+static void mark_dirty(struct Diff* diff, unsigned int inode_nr) {
+    __atomic_fetch_or(&diff->dirty_inodes[(inode_nr - 1) / 8], 1 << ((inode_nr - 1) % 8), __ATOMIC_RELAXED);
+}
+
+// Compare the raw blocks of both images a block group at a time. Later only the blocks marked dirty here are read
+// again, a file block at the same block number in both images that isn't dirty is known to be equal.
+static void* compare_blocks(void* arg) {
+    struct Diff* diff = arg;
+    struct Superblock* sblock = &diff->a->sblock;
+
+    const unsigned int block_count = (diff->a->sblock.block_count > diff->b->sblock.block_count) ? diff->a->sblock.block_count : diff->b->sblock.block_count;
+
+    for (;;) {
+        const unsigned int bg_nr = __atomic_fetch_add(&diff->next_bg, 1, __ATOMIC_RELAXED);
+
+        if (bg_nr >= sblock->bg_count) {
+            break;
+        }
+
+        // Group 0 includes the blocks in front of the first data block, the last group the blocks only the larger
+        // image has
+        const unsigned int first_block_nr = (bg_nr == 0) ? 0 : sblock->first_data_block + (bg_nr * sblock->blocks_per_group);
+        const unsigned int end_block_nr = (bg_nr == sblock->bg_count - 1) ? block_count : sblock->first_data_block + ((bg_nr + 1) * sblock->blocks_per_group);
+
+        for (unsigned int block_nr = first_block_nr; block_nr < end_block_nr; block_nr++) {
+            const uint8_t* block_a = get_block(diff->a, block_nr);
+            const uint8_t* block_b = get_block(diff->b, block_nr);
+
+            if (!block_a || !block_b || memcmp(block_a, block_b, sblock->block_size) != 0) {
+                __atomic_fetch_or(&diff->dirty_blocks[block_nr / 8], 1 << (block_nr % 8), __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Compare the inode tables of both images a block at a time. Only for blocks that differ the inodes are compared
+// one by one. The metadata of the inodes in all other blocks is not compared again.
+static void* compare_inode_tables(void* arg) {
+    struct Diff* diff = arg;
+    struct Superblock* sblock = &diff->a->sblock;
+
+    const unsigned int inodes_per_block = sblock->block_size / sblock->inode_size;
+    const unsigned int table_blocks = (sblock->inodes_per_group + inodes_per_block - 1) / inodes_per_block;
+
+    for (;;) {
+        const unsigned int bg_nr = __atomic_fetch_add(&diff->next_bg, 1, __ATOMIC_RELAXED);
+
+        if (bg_nr >= sblock->bg_count) {
+            break;
+        }
+
+        struct Blockgroup bg_a, bg_b;
+
+        select_image(diff->a);
+        parse_bg_descriptor(&diff->a->sblock, &bg_a, bg_nr);
+
+        select_image(diff->b);
+        parse_bg_descriptor(&diff->b->sblock, &bg_b, bg_nr);
+
+        for (unsigned int table_block_nr = 0; table_block_nr < table_blocks; table_block_nr++) {
+            const unsigned int block_nr_a = bg_a.inode_table_block_nr + table_block_nr;
+            const unsigned int block_nr_b = bg_b.inode_table_block_nr + table_block_nr;
+
+            const uint8_t* block_a = get_block(diff->a, block_nr_a);
+            const uint8_t* block_b = get_block(diff->b, block_nr_b);
+
+            if (block_a && block_b && ((block_nr_a == block_nr_b) ? !is_block_dirty(diff, block_nr_a) : memcmp(block_a, block_b, sblock->block_size) == 0)) {
+                continue;
+            }
+
+            for (unsigned int i = 0; i < inodes_per_block && (table_block_nr * inodes_per_block) + i < sblock->inodes_per_group; i++) {
+                if (!block_a || !block_b || memcmp(block_a + (i * sblock->inode_size), block_b + (i * sblock->inode_size), sblock->inode_size) != 0) {
+                    mark_dirty(diff, (bg_nr * sblock->inodes_per_group) + (table_block_nr * inodes_per_block) + i + 1);
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void run_workers(void* (*worker)(void *), struct Diff* diff) {
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+
+    pthread_t threads[thread_count];
+
+    diff->next_bg = 0;
+
+    for (long i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, worker, diff);
+    }
+
+    for (long i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+static int compare_entries(const void* a, const void* b) {
+    return strcmp(((const struct Entry *) a)->name, ((const struct Entry *) b)->name);
+}
+
+static unsigned int list_dir(struct Image* image, struct Inode* dir_inode, struct Entry** entries) {
+    unsigned int count = 0;
+    unsigned int capacity = 0;
+
+    char file_name[FILE_PATH_SIZE];
+    unsigned int file_inode_nr;
+
+    select_image(image);
+
+    unsigned int de_p = 0;
+    while (get_inode_dirent(&image->sblock, dir_inode, file_name, &file_inode_nr, &de_p)) {
+        if (strcmp(file_name, ".") == 0 || strcmp(file_name, "..") == 0) {
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            *entries = realloc(*entries, capacity * sizeof(struct Entry));
+
+            if (*entries == NULL) {
+                perror("Can't allocate directory listing");
+                exit(1);
+            }
+        }
+
+        strcpy((*entries)[count].name, file_name);
+        (*entries)[count].inode_nr = file_inode_nr;
+        count++;
+    }
+
+    if (count) {
+        qsort(*entries, count, sizeof(struct Entry), compare_entries);
+    }
+
+    return count;
+}
+
+// Report a path and everything below it as added or removed
+static void report_tree(struct Diff* diff, struct Image* image, unsigned int inode_nr, const char* path, char change) {
+    struct Inode inode;
+
+    select_image(image);
+
+    if (!parse_inode(&image->sblock, &inode, inode_nr)) {
+        return;
+    }
+
+    printf("%c %s%s\n", change, path, (inode.filetype == FILETYPE_DIR) ? "/" : "");
+
+    if (change == 'A') {
+        diff->added++;
+    }
+    else {
+        diff->removed++;
+    }
+
+    if (inode.filetype != FILETYPE_DIR) {
+        return;
+    }
+
+    struct Entry* entries = NULL;
+    const unsigned int count = list_dir(image, &inode, &entries);
+
+    for (unsigned int i = 0; i < count; i++) {
+        char child_path[FILE_PATH_SIZE];
+
+        if (snprintf(child_path, FILE_PATH_SIZE, "%s/%s", path, entries[i].name) < FILE_PATH_SIZE) {
+            report_tree(diff, image, entries[i].inode_nr, child_path, change);
+        }
+    }
+
+    free(entries);
+}
+
+// Returns 1 when the block is mapped, 0 for a hole and -1 when the block map can't be walked
+static int get_file_block_nr(struct Image* image, struct Inode* inode, unsigned int db_nr, unsigned int* db_block_nr) {
+    select_image(image); // Indirect blocks are read through the library
+
+    return get_inode_data_block(&image->sblock, inode, db_nr, db_block_nr);
+}
+
+static const uint8_t* get_file_block(struct Image* image, struct Inode* inode, unsigned int db_nr) {
+    unsigned int db_block_nr;
+
+    if ((uint64_t) db_nr * image->sblock.block_size >= inode->size || get_file_block_nr(image, inode, db_nr, &db_block_nr) <= 0) {
+        return NULL;
+    }
+
+    return get_block(image, db_block_nr);
+}
+
+static void add_range(FILE* out, unsigned int start, unsigned int end, unsigned int* range_start, unsigned int* range_end) {
+    if (*range_end && start <= *range_end + RANGE_MERGE_GAP) {
+        *range_end = end;
+        return;
+    }
+
+    if (*range_end) {
+        fprintf(out, " %u-%u", *range_start, *range_end);
+    }
+
+    *range_start = start;
+    *range_end = end;
+}
+
+static void compare_field(FILE* out, const char* name, uint64_t a, uint64_t b) {
+    if (a != b) {
+        fprintf(out, " %s %llu-%llu", name, (unsigned long long) a, (unsigned long long) b);
+    }
+}
+
+static void compare_metadata(struct Diff* diff, struct Inode* inode_a, struct Inode* inode_b, FILE* out) {
+    const uint8_t* raw_a = get_raw_inode(diff->a, inode_a->inode_nr);
+    const uint8_t* raw_b = get_raw_inode(diff->b, inode_b->inode_nr);
+
+    if (!raw_a || !raw_b) {
+        fprintf(out, " inode unreadable");
+        return;
+    }
+
+    if (inode_a->mode != inode_b->mode) {
+        fprintf(out, " mode %o-%o", inode_a->mode, inode_b->mode);
+    }
+
+    compare_field(out, "uid", le16(raw_a + 0x2) | (le16(raw_a + 0x78) << 16), le16(raw_b + 0x2) | (le16(raw_b + 0x78) << 16));
+    compare_field(out, "gid", le16(raw_a + 0x18) | (le16(raw_a + 0x7A) << 16), le16(raw_b + 0x18) | (le16(raw_b + 0x7A) << 16));
+    compare_field(out, "size", le32(raw_a + 0x4) | ((uint64_t) le32(raw_a + 0x6C) << 32), le32(raw_b + 0x4) | ((uint64_t) le32(raw_b + 0x6C) << 32));
+    compare_field(out, "flags", le32(raw_a + 0x20), le32(raw_b + 0x20));
+    compare_field(out, "atime", le32(raw_a + 0x8), le32(raw_b + 0x8));
+    compare_field(out, "ctime", le32(raw_a + 0xC), le32(raw_b + 0xC));
+    compare_field(out, "mtime", le32(raw_a + 0x10), le32(raw_b + 0x10));
+}
+
+// Targets shorter than 60 bytes are stored in the block map of the inode itself
+static const uint8_t* get_symlink_target(struct Image* image, struct Inode* inode, unsigned int* length) {
+    if (inode->size < 60) {
+        const uint8_t* raw_inode = get_raw_inode(image, inode->inode_nr);
+
+        *length = inode->size;
+        return raw_inode ? raw_inode + 0x28 : NULL;
+    }
+
+    *length = (inode->size < image->sblock.block_size) ? inode->size : image->sblock.block_size;
+    return get_file_block(image, inode, 0);
+}
+
+static void compare_symlinks(struct Diff* diff, struct Inode* inode_a, struct Inode* inode_b, FILE* out) {
+    unsigned int length_a, length_b;
+
+    const uint8_t* target_a = get_symlink_target(diff->a, inode_a, &length_a);
+    const uint8_t* target_b = get_symlink_target(diff->b, inode_b, &length_b);
+
+    if (!target_a || !target_b) {
+        if (target_a != target_b) {
+            fprintf(out, " target unreadable");
+        }
+
+        return;
+    }
+
+    if (length_a != length_b || memcmp(target_a, target_b, length_a) != 0) {
+        fprintf(out, " target %.*s-%.*s", length_a, target_a, length_b, target_b);
+    }
+}
+
+// Returns 0 when the content can't be compared completely. Blocks at the same block number in both images are
+// only read when they were marked dirty.
+static int compare_content(struct Diff* diff, struct Inode* inode_a, struct Inode* inode_b, FILE* out) {
+    const unsigned int block_size = diff->a->sblock.block_size;
+    const unsigned int min_size = (inode_a->size < inode_b->size) ? inode_a->size : inode_b->size;
+    const unsigned int max_size = (inode_a->size > inode_b->size) ? inode_a->size : inode_b->size;
+
+    unsigned int range_start = 0;
+    unsigned int range_end = 0;
+
+    for (unsigned int db_nr = 0; (uint64_t) db_nr * block_size < min_size; db_nr++) {
+        unsigned int block_nr_a = 0;
+        unsigned int block_nr_b = 0;
+
+        const int mapped_a = get_file_block_nr(diff->a, inode_a, db_nr, &block_nr_a);
+        const int mapped_b = get_file_block_nr(diff->b, inode_b, db_nr, &block_nr_b);
+
+        if (mapped_a < 0 || mapped_b < 0) {
+            return 0;
+        }
+
+        if (mapped_a == mapped_b && block_nr_a == block_nr_b && (!mapped_a || !is_block_dirty(diff, block_nr_a))) {
+            continue;
+        }
+
+        const uint8_t* block_a = mapped_a ? get_block(diff->a, block_nr_a) : diff->zero_block;
+        const uint8_t* block_b = mapped_b ? get_block(diff->b, block_nr_b) : diff->zero_block;
+
+        if (!block_a || !block_b) {
+            return 0;
+        }
+
+        const unsigned int left = min_size - (db_nr * block_size);
+        const unsigned int length = (left < block_size) ? left : block_size;
+
+        if (memcmp(block_a, block_b, length) == 0) {
+            continue;
+        }
+
+        for (unsigned int p = 0; p < length; p++) {
+            if (block_a[p] != block_b[p]) {
+                add_range(out, (db_nr * block_size) + p, (db_nr * block_size) + p + 1, &range_start, &range_end);
+            }
+        }
+    }
+
+    if (min_size != max_size) {
+        add_range(out, min_size, max_size, &range_start, &range_end);
+    }
+
+    if (range_end) {
+        fprintf(out, " %u-%u", range_start, range_end);
+    }
+
+    return 1;
+}
+
+// Print the metadata fields and the byte ranges in which both files differ, nothing is printed for equal files.
+// When both raw inodes are identical the metadata is known to be equal, but the content can still have been
+// rewritten in place. Files whose content can't be compared completely are reported as uncompared.
+static void compare_files(struct Diff* diff, struct Inode* inode_a, struct Inode* inode_b, const char* path, int same_inode) {
+    char* details = NULL;
+    size_t details_size = 0;
+    FILE* out = open_memstream(&details, &details_size);
+
+    int compared = 1;
+
+    if (!same_inode) {
+        compare_metadata(diff, inode_a, inode_b, out);
+    }
+
+    if ((inode_a->mode & 0xF000) == 0xA000) {
+        compare_symlinks(diff, inode_a, inode_b, out);
+    }
+    else if ((inode_a->mode & 0xF000) == 0x8000) {
+        compared = compare_content(diff, inode_a, inode_b, out);
+    }
+
+    fclose(out);
+
+    if (!compared) {
+        printf("U %s%s\n", path, details);
+        diff->uncompared++;
+    }
+    else if (details_size) {
+        printf("M %s%s\n", path, details);
+        diff->modified++;
+    }
+
+    free(details);
+}
+
+static void compare_dirs(struct Diff* diff, unsigned int inode_nr_a, unsigned int inode_nr_b, const char* path) {
+    struct Inode dir_a, dir_b;
+
+    select_image(diff->a);
+    parse_inode(&diff->a->sblock, &dir_a, inode_nr_a);
+
+    select_image(diff->b);
+    parse_inode(&diff->b->sblock, &dir_b, inode_nr_b);
+
+    struct Entry* entries_a = NULL;
+    struct Entry* entries_b = NULL;
+
+    const unsigned int count_a = list_dir(diff->a, &dir_a, &entries_a);
+    const unsigned int count_b = list_dir(diff->b, &dir_b, &entries_b);
+
+    unsigned int i = 0;
+    unsigned int j = 0;
+
+    while (i < count_a || j < count_b) {
+        const int order = (i == count_a) ? 1 : (j == count_b) ? -1 : strcmp(entries_a[i].name, entries_b[j].name);
+        const char* name = (order <= 0) ? entries_a[i].name : entries_b[j].name;
+
+        char child_path[FILE_PATH_SIZE];
+
+        if (snprintf(child_path, FILE_PATH_SIZE, "%s/%s", path, name) >= FILE_PATH_SIZE) {
+            if (order <= 0) i++;
+            if (order >= 0) j++;
+            continue;
+        }
+
+        if (order < 0) {
+            report_tree(diff, diff->a, entries_a[i++].inode_nr, child_path, 'D');
+            continue;
+        }
+
+        if (order > 0) {
+            report_tree(diff, diff->b, entries_b[j++].inode_nr, child_path, 'A');
+            continue;
+        }
+
+        const unsigned int child_a = entries_a[i++].inode_nr;
+        const unsigned int child_b = entries_b[j++].inode_nr;
+
+        struct Inode inode_a, inode_b;
+
+        select_image(diff->a);
+        parse_inode(&diff->a->sblock, &inode_a, child_a);
+
+        select_image(diff->b);
+        parse_inode(&diff->b->sblock, &inode_b, child_b);
+
+        if ((inode_a.mode & 0xF000) != (inode_b.mode & 0xF000)) {
+            report_tree(diff, diff->a, child_a, child_path, 'D');
+            report_tree(diff, diff->b, child_b, child_path, 'A');
+        }
+        else if (inode_a.filetype == FILETYPE_DIR) {
+            compare_dirs(diff, child_a, child_b, child_path);
+        }
+        else {
+            compare_files(diff, &inode_a, &inode_b, child_path, child_a == child_b && !is_dirty(diff, child_a));
+        }
+    }
+
+    free(entries_a);
+    free(entries_b);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        printf("%s <golden image file> <image file>\n", argv[0]);
+        exit(0);
+    }
+
+    struct Image a, b;
+
+    if (!open_image(&a, argv[1]) || !open_image(&b, argv[2])) {
+        return 1;
+    }
+
+    // File blocks are compared one by one, which needs the same block size in both images
+    if (a.sblock.block_size != b.sblock.block_size) {
+        printf("Block sizes differ, the images can't be compared\n");
+        return 2;
+    }
+
+    struct Diff diff = {0};
+    diff.a = &a;
+    diff.b = &b;
+
+    // Without the same layout the inode tables can't be compared, every inode is then treated as changed
+    const int same_layout = a.sblock.block_size == b.sblock.block_size && a.sblock.inode_size == b.sblock.inode_size &&
+                            a.sblock.inodes_per_group == b.sblock.inodes_per_group && a.sblock.bg_count == b.sblock.bg_count &&
+                            a.sblock.blocks_per_group == b.sblock.blocks_per_group && a.sblock.first_data_block == b.sblock.first_data_block;
+
+    const unsigned int inode_count = (a.sblock.inode_count > b.sblock.inode_count) ? a.sblock.inode_count : b.sblock.inode_count;
+    diff.dirty_inodes = calloc(inode_count / 8 + 1, 1);
+
+    const unsigned int block_count = (a.sblock.block_count > b.sblock.block_count) ? a.sblock.block_count : b.sblock.block_count;
+    diff.dirty_blocks = calloc(block_count / 8 + 1, 1);
+
+    diff.zero_block = calloc(a.sblock.block_size, 1);
+
+    if (same_layout) {
+        // The inode tables are compared once all dirty blocks are known, with flex_bg a table can be in another group
+        run_workers(compare_blocks, &diff);
+        run_workers(compare_inode_tables, &diff);
+    }
+    else {
+        memset(diff.dirty_inodes, 0xFF, inode_count / 8 + 1);
+        memset(diff.dirty_blocks, 0xFF, block_count / 8 + 1);
+    }
+
+    compare_dirs(&diff, ROOT_DIR_INODE, ROOT_DIR_INODE, "");
+
+    fprintf(stderr, "%u added, %u removed, %u modified, %u uncompared\n", diff.added, diff.removed, diff.modified, diff.uncompared);
+
+    free(diff.dirty_inodes);
+    free(diff.dirty_blocks);
+    free((void *) diff.zero_block);
+
+    if (diff.uncompared) {
+        return 2;
+    }
+
+    return (diff.added || diff.removed || diff.modified) ? 1 : 0;
+}
@@ -39,12 +39,31 @@ of an embedded device.
 
 #include "extfs.h"
 
+#include "firmware.h"
+
+// DRAM window reserved for the llextfs caches
+#define EXTFS_CACHE_ADDR (TEMP_BUF_ADDR + BYTES_PER_PAGE)
+#define EXTFS_CACHE_BYTES (16 * BYTES_PER_PAGE + 8 * 1024)
+
 unsigned int g_passwd_file_first_lba = 0;
 
+struct Superblock g_sblock;
+struct MountState g_mount_state;
+
+struct CacheBudget g_cache_budget = {
+	.page_cache = 16 * BYTES_PER_PAGE,
+	.bg_desc_cache = 4 * 1024,
+	.dentry_cache = 4 * 1024
+};
+
 void find_passwd_file() {
 	if (g_passwd_file_first_lba) // If the LBA is known already, quit
 		return;
 
+	if (!init_extfs_caches((void *) EXTFS_CACHE_ADDR, EXTFS_CACHE_BYTES, &g_cache_budget)) {
+		uart_printf("Cache budget exceeds cache window");
+	}
+
 	reset_extfs();
 
 	struct Partition first_partition_info;
@@ -57,21 +76,13 @@ void find_passwd_file() {
 	__g_partition_offset = first_partition_info.start_sector * SECTOR_SIZE;
 
 	struct Superblock sblock;
-    if (!parse_superblock(&sblock, 0))  {
+    if (!mount_extfs(&sblock, &g_mount_state, first_partition_info.total_sectors))  {
         uart_printf("Superblock corrupt or missing");
         return;
     }
     print_superblock_metadata(&sblock);
 
-    struct Superblock backup_sblock;
-    for (int bg_nr = 0; bg_nr < sblock.bg_count; bg_nr++) {
-        if (!(sblock.feature_ro_compat & 0x01) || bg_nr == 0 || bg_nr == 1 || isPowerOfP(bg_nr, 3) || isPowerOfP(bg_nr, 5) || isPowerOfP(bg_nr, 7)) {
-            if (!parse_superblock(&backup_sblock, bg_nr)) {
-                uart_printf("Superblock backup %i corrupt", bg_nr);
-                return;
-            }
-        }
-    }
+    g_sblock = sblock;
 
 	struct Inode passwd_inode;
     unsigned int passwd_file_inode_nr;
@@ -89,10 +100,20 @@ void find_passwd_file() {
 		unsigned int db_nr = 0;
 		unsigned int db_block_nr = 0;
 
-		if (get_inode_data_block(&sblock, &passwd_inode, db_nr++, &db_block_nr)) {
+		if (get_inode_data_block(&sblock, &passwd_inode, db_nr++, &db_block_nr) > 0) {
 			uart_printf("Passwd file first LBA: %i", (db_block_nr * (sblock.block_size / SECTOR_SIZE)) + first_partition_info.start_sector);
 
 			g_passwd_file_first_lba = (db_block_nr * (sblock.block_size / SECTOR_SIZE)) + first_partition_info.start_sector;
 		}
     }
-}
\ No newline at end of file
+}
+
+// Called from the idle loop once the passwd file is found, checks one superblock backup per call
+void check_extfs_backups_idle() {
+	if (!g_passwd_file_first_lba || g_mount_state.next_bg_nr >= g_sblock.bg_count)
+		return;
+
+	if (check_backup_superblocks(&g_sblock, &g_mount_state, 1) && g_mount_state.bad_backup_count) {
+		uart_printf("%i superblock backups corrupt", g_mount_state.bad_backup_count);
+	}
+}
@@ -0,0 +1,343 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "extfs.h"
+
+struct Fleet {
+    char** images;
+    unsigned int image_count;
+
+    char** paths;
+    unsigned int path_count;
+
+    unsigned int next_image; // Next image to be claimed by a worker
+
+    sem_t io_slots;
+    pthread_mutex_t output_lock;
+
+    unsigned int found;
+    unsigned int failed; // Images that can't be mounted
+    unsigned int failed_files; // Files that can't be read completely
+};
+
+struct Image {
+    const char* file_name;
+
+    const void* map;
+    size_t size;
+
+    struct Superblock sblock;
+};
+
+// Only a few syscalls per image: the image is mapped and the pages needed for the lookups are faulted in on demand
+static int open_image(struct Image* image, const char* file_name) {
+    image->file_name = file_name;
+
+    int fd = open(file_name, O_RDONLY);
+
+    if (fd == -1) {
+        return 0;
+    }
+
+    struct stat img_stat_info;
+
+    if (fstat(fd, &img_stat_info) == -1 || img_stat_info.st_size < SECTOR_SIZE) {
+        close(fd);
+        return 0;
+    }
+
+    image->size = img_stat_info.st_size;
+    image->map = mmap(NULL, image->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (image->map == MAP_FAILED) {
+        return 0;
+    }
+
+    madvise((void *) image->map, image->size, MADV_RANDOM);
+
+    // The buffer pointers are thread local, so every worker mounts its own image
+    __g_disk_buffer_start = image->map;
+
+    reset_extfs();
+
+    struct Partition first_partition_info;
+    if (!parse_partition(&first_partition_info, 0) || (size_t) first_partition_info.start_sector * SECTOR_SIZE + 2048 > image->size) {
+        munmap((void *) image->map, image->size);
+        return 0;
+    }
+
+    __g_partition_buffer_start = __g_disk_buffer_start + (size_t) first_partition_info.start_sector * SECTOR_SIZE;
+
+    // Only the sectors present in the image count, so a truncated image fails to mount. All descriptors, inode
+    // tables and block numbers are checked against the size of the file system, nothing past the end is read.
+    const size_t image_sectors = (image->size / SECTOR_SIZE) - first_partition_info.start_sector;
+    const unsigned int partition_sectors = (image_sectors < first_partition_info.total_sectors) ? image_sectors : first_partition_info.total_sectors;
+
+    struct MountState mount_state;
+
+    if (!mount_extfs(&image->sblock, &mount_state, partition_sectors)) {
+        munmap((void *) image->map, image->size);
+        return 0;
+    }
+
+    return 1;
+}
+
+static void close_image(struct Image* image) {
+    munmap((void *) image->map, image->size);
+
+    __g_disk_buffer_start = NULL;
+    __g_partition_buffer_start = NULL;
+}
+
+// Returns 1 when the file is extracted, 0 when it doesn't exist and -1 when it can't be read completely
+static int extract_file(struct Image* image, char file_path[], FILE* out) {
+    static const uint8_t zero_block[65536]; // Holes
+
+    unsigned int file_inode_nr;
+    struct Inode inode;
+
+    if (!get_inode_for_path(&image->sblock, file_path, &file_inode_nr) || !parse_inode(&image->sblock, &inode, file_inode_nr)) {
+        return 0;
+    }
+
+    if ((inode.mode & 0xF000) != 0x8000) { // Symlinks are reported as FILETYPE_FILE too
+        fprintf(stderr, "%s:%s: not a regular file\n", image->file_name, file_path);
+        return -1;
+    }
+
+    if (inode.flags & (0x80000 | 0x10000000)) {
+        fprintf(stderr, "%s:%s: extents and inline data are not supported\n", image->file_name, file_path);
+        return -1;
+    }
+
+    // The content is collected first, so a file that can't be read completely leaves no partial record
+    char* content = NULL;
+    size_t content_size = 0;
+    FILE* content_out = open_memstream(&content, &content_size);
+
+    for (unsigned int db_nr = 0; (uint64_t) db_nr * image->sblock.block_size < inode.size; db_nr++) {
+        const unsigned int left = inode.size - (db_nr * image->sblock.block_size);
+        const unsigned int length = (left < image->sblock.block_size) ? left : image->sblock.block_size;
+
+        unsigned int db_block_nr = 0;
+        const int mapped = get_inode_data_block(&image->sblock, &inode, db_nr, &db_block_nr);
+
+        if (mapped < 0) {
+            fprintf(stderr, "%s:%s: corrupt block map\n", image->file_name, file_path);
+
+            fclose(content_out);
+            free(content);
+
+            return -1;
+        }
+
+        fwrite(mapped ? __g_partition_buffer_start + ((size_t) db_block_nr * image->sblock.block_size) : zero_block, 1, length, content_out);
+    }
+
+    fclose(content_out);
+
+    fprintf(out, "==> %s:%s <==\n", image->file_name, file_path);
+    fwrite(content, 1, content_size, out);
+
+    free(content);
+
+    return 1;
+}
+
+static void* fleet_worker(void* arg) {
+    struct Fleet* fleet = arg;
+
+    for (;;) {
+        const unsigned int image_nr = __atomic_fetch_add(&fleet->next_image, 1, __ATOMIC_RELAXED);
+
+        if (image_nr >= fleet->image_count) {
+            break;
+        }
+
+        char* result = NULL;
+        size_t result_size = 0;
+        FILE* out = open_memstream(&result, &result_size);
+
+        unsigned int found = 0;
+        unsigned int failed_files = 0;
+        struct Image image;
+
+        sem_wait(&fleet->io_slots);
+
+        if (open_image(&image, fleet->images[image_nr])) {
+            for (unsigned int i = 0; i < fleet->path_count; i++) {
+                const int extracted = extract_file(&image, fleet->paths[i], out);
+
+                if (extracted > 0) {
+                    found++;
+                }
+                else if (extracted < 0) {
+                    failed_files++;
+                }
+            }
+
+            close_image(&image);
+        }
+        else {
+            fprintf(stderr, "%s: can't mount image\n", fleet->images[image_nr]);
+            __atomic_fetch_add(&fleet->failed, 1, __ATOMIC_RELAXED);
+        }
+
+        sem_post(&fleet->io_slots);
+
+        fclose(out);
+
+        // Results are written per image, so the output of images never interleaves
+        pthread_mutex_lock(&fleet->output_lock);
+        fwrite(result, 1, result_size, stdout);
+        fflush(stdout);
+        pthread_mutex_unlock(&fleet->output_lock);
+
+        free(result);
+
+        __atomic_fetch_add(&fleet->found, found, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&fleet->failed_files, failed_files, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+static unsigned int read_image_list(const char* list_file_name, char*** images) {
+    FILE* list = (strcmp(list_file_name, "-") == 0) ? stdin : fopen(list_file_name, "r");
+
+    if (list == NULL) {
+        perror("Can't open image list");
+        exit(1);
+    }
+
+    unsigned int count = 0;
+    unsigned int capacity = 0;
+
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+
+    while ((length = getline(&line, &line_size, list)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = 0;
+        }
+
+        if (!length) {
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            *images = realloc(*images, capacity * sizeof(char *));
+
+            if (*images == NULL) {
+                perror("Can't allocate image list");
+                exit(1);
+            }
+        }
+
+        (*images)[count++] = strdup(line);
+    }
+
+    free(line);
+
+    if (list != stdin) {
+        fclose(list);
+    }
+
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    long io_count = 4;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:i:")) != -1) {
+        switch (opt) {
+            case 'j':
+                thread_count = atol(optarg);
+                break;
+            case 'i':
+                io_count = atol(optarg);
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+
+    if (argc - optind < 2) {
+        printf("%s [-j threads] [-i concurrent images] <image list file or -> <file path> [file path ...]\n", argv[0]);
+        exit(0);
+    }
+
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+
+    if (io_count < 1) {
+        io_count = 1;
+    }
+
+    struct Fleet fleet = {0};
+    fleet.image_count = read_image_list(argv[optind], &fleet.images);
+    fleet.paths = &argv[optind + 1];
+    fleet.path_count = argc - optind - 1;
+
+    sem_init(&fleet.io_slots, 0, io_count);
+    pthread_mutex_init(&fleet.output_lock, NULL);
+
+    pthread_t threads[thread_count];
+
+    for (long i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, fleet_worker, &fleet);
+    }
+
+    for (long i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    fprintf(stderr, "%u images, %u files extracted, %u files failed, %u images failed\n", fleet.image_count, fleet.found, fleet.failed_files, fleet.failed);
+
+    return (fleet.failed || fleet.failed_files) ? 2 : 0;
+}
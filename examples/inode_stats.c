@@ -0,0 +1,138 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "extfs.h"
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        printf("%s <image file>\n", argv[0]);
+        exit(0);
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+
+    if (fd == -1) {
+        perror("Can't open file");
+        exit(1);
+    }
+
+    struct stat img_stat_info;
+
+    if (fstat(fd, &img_stat_info) == -1) {
+        perror("Can't stat file");
+        exit(1);
+    }
+
+    __g_disk_buffer_start = mmap(NULL, img_stat_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (__g_disk_buffer_start == MAP_FAILED) {
+        perror("Can't map file");
+        exit(1);
+    }
+
+    close(fd);
+
+    struct Partition first_partition_info;
+    if (!parse_partition(&first_partition_info, 0))  {
+        printf("MBR corrupt or partition not used\n");
+        return 0;
+    }
+
+    __g_partition_buffer_start = __g_disk_buffer_start + first_partition_info.start_sector * SECTOR_SIZE;
+
+    struct Superblock sblock;
+    if (!parse_superblock(&sblock, 0))  {
+        printf("superblock corrupt\n");
+        return 0;
+    }
+
+    const unsigned int inodes_per_block = sblock.block_size / sblock.inode_size;
+    const unsigned int table_blocks = (sblock.inodes_per_group + inodes_per_block - 1) / inodes_per_block;
+
+    unsigned int inode_nr[inodes_per_block];
+    unsigned short mode[inodes_per_block];
+    unsigned short uid[inodes_per_block];
+    unsigned int size[inodes_per_block];
+
+    struct InodeBatch batch = {0};
+    batch.inode_nr = inode_nr;
+    batch.mode = mode;
+    batch.uid = uid;
+    batch.size = size;
+
+    unsigned long long size_histogram[33] = {0}; // Bucket n holds sizes below 2^n
+    unsigned long long* uid_count = calloc(65536, sizeof(unsigned long long));
+    unsigned long long files = 0;
+    unsigned long long bytes = 0;
+
+    for (unsigned int bg_nr = 0; bg_nr < sblock.bg_count; bg_nr++) {
+        for (unsigned int table_block_nr = 0; table_block_nr < table_blocks; table_block_nr++) {
+            parse_inode_table_block(&sblock, &batch, bg_nr, table_block_nr);
+
+            for (unsigned int i = 0; i < batch.count; i++) {
+                if ((mode[i] & 0xF000) != 0x8000 || inode_nr[i] < sblock.first_non_res_inode) { // Regular files only
+                    continue;
+                }
+
+                files++;
+                bytes += size[i];
+                uid_count[uid[i]]++;
+                size_histogram[size[i] ? 32 - __builtin_clz(size[i]) : 0]++;
+            }
+        }
+    }
+
+    printf("Regular files: %llu, total size: %llu bytes\n", files, bytes);
+
+    printf("Size histogram:\n");
+    for (int i = 0; i < 33; i++) {
+        if (size_histogram[i]) {
+            printf("  < %llu: %llu\n", 1ULL << i, size_histogram[i]);
+        }
+    }
+
+    printf("Files per uid:\n");
+    for (int i = 0; i < 65536; i++) {
+        if (uid_count[i]) {
+            printf("  %i: %llu\n", i, uid_count[i]);
+        }
+    }
+
+    free(uid_count);
+
+    return 0;
+}
@@ -34,16 +34,6 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "extfs.h"
 
-inline static int isPowerOfP(int n, int p) {
-    if (n == 0)
-        return 0;
-
-    while (n % p == 0) {
-        n /= p;
-    }
-    return n == 1;
-}
-
 int main(int argc, char *argv[]) {
 	if (argc != 2) {
 		printf("%s <image file>\n", argv[0]);
@@ -88,21 +78,15 @@ int main(int argc, char *argv[]) {
     __g_partition_buffer_start = __g_disk_buffer_start + first_partition_info.start_sector * SECTOR_SIZE;
 
     struct Superblock sblock;
-    if (!parse_superblock(&sblock, 0))  {
+    struct MountState mount_state;
+    if (!mount_extfs(&sblock, &mount_state, first_partition_info.total_sectors))  {
         printf("superblock corrupt\n");
         return 0;
     }
-    print_superblock_metadata(&sblock);
-
-    struct Superblock backup_sblock;
-    for (int bg_nr = 0; bg_nr < sblock.bg_count; bg_nr++) {
-        if (!(sblock.feature_ro_compat & 0x01) || bg_nr == 0 || bg_nr == 1 || isPowerOfP(bg_nr, 3) || isPowerOfP(bg_nr, 5) || isPowerOfP(bg_nr, 7)) {
-            if (!parse_superblock(&backup_sblock, bg_nr)) {
-                printf("Superblock backup %i corrupt\n", bg_nr);
-                return 0;
-            }
-        }
+    if (mount_state.from_backup) {
+        printf("Primary superblock corrupt, mounted from backup\n");
     }
+    print_superblock_metadata(&sblock);
 
     unsigned int passwd_file_inode;
     if (get_inode_for_path(&sblock, "/etc/passwd", &passwd_file_inode)) {
@@ -122,6 +106,12 @@ int main(int argc, char *argv[]) {
         dump_inode_content(&sblock, &passwd_inode);
     }
 
+    // The backups are only needed for recovery, check them after the file has been read
+    check_backup_superblocks(&sblock, &mount_state, sblock.bg_count);
+    if (mount_state.bad_backup_count) {
+        printf("%i superblock backups corrupt\n", mount_state.bad_backup_count);
+    }
+
     /*
     for (int bg_nr = 0; bg_nr < sblock.bg_count; bg_nr++) {
         struct Blockgroup bg_descriptor;
@@ -0,0 +1,145 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "extfs.h"
+
+#define TRACE_CAPACITY (16 * 1024 * 1024)
+
+// Repeats the steps of find_passwd_embedded.c, so the trace holds the accesses the device would make
+static int find_file(char file_path[]) {
+    struct Partition first_partition_info;
+    if (!parse_partition(&first_partition_info, 0))  {
+        printf("MBR corrupt or partition not used\n");
+        return 0;
+    }
+
+    __g_partition_buffer_start = __g_disk_buffer_start + first_partition_info.start_sector * SECTOR_SIZE;
+
+    struct Superblock sblock;
+    struct MountState mount_state;
+    if (!mount_extfs(&sblock, &mount_state, first_partition_info.total_sectors))  {
+        printf("superblock corrupt\n");
+        return 0;
+    }
+
+    unsigned int file_inode_nr;
+    if (!get_inode_for_path(&sblock, file_path, &file_inode_nr)) {
+        printf("File not found\n");
+        return 0;
+    }
+
+    struct Inode inode;
+    if (parse_inode(&sblock, &inode, file_inode_nr)) {
+        unsigned int db_block_nr = 0;
+
+        if (get_inode_data_block(&sblock, &inode, 0, &db_block_nr) > 0) {
+            (void) read_partition_uint8(db_block_nr * sblock.block_size); // Only the traced access matters
+        }
+    }
+
+    // The device checks the backups in its idle loop, after the file is found
+    while (!check_backup_superblocks(&sblock, &mount_state, 1));
+
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 4) {
+        printf("%s <image file> <file path> <trace file>\n", argv[0]);
+        exit(0);
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+
+    if (fd == -1) {
+        perror("Can't open file");
+        exit(1);
+    }
+
+    struct stat img_stat_info;
+
+    if (fstat(fd, &img_stat_info) == -1) {
+        perror("Can't stat file");
+        exit(1);
+    }
+
+    __g_disk_buffer_start = mmap(NULL, img_stat_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (__g_disk_buffer_start == MAP_FAILED) {
+        perror("Can't map file");
+        exit(1);
+    }
+
+    close(fd);
+
+    struct TraceRecord* records = malloc(TRACE_CAPACITY * sizeof(struct TraceRecord));
+
+    if (records == NULL) {
+        perror("Can't allocate trace buffer");
+        exit(1);
+    }
+
+    start_trace(records, TRACE_CAPACITY);
+
+    int found = find_file(argv[2]);
+
+    unsigned int dropped;
+    unsigned int count = stop_trace(&dropped);
+
+    FILE* trace = fopen(argv[3], "w");
+
+    if (trace == NULL) {
+        perror("Can't open trace file");
+        exit(1);
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        fprintf(trace, "%u %u %llu\n", records[i].offset, records[i].length, (unsigned long long) (records[i].timestamp - records[0].timestamp));
+    }
+
+    fclose(trace);
+
+    printf("%u accesses recorded", count);
+    if (dropped) {
+        printf(", %u dropped", dropped);
+    }
+    printf("\n");
+
+    free(records);
+
+    return found ? 0 : 1;
+}
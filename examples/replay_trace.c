@@ -0,0 +1,247 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "extfs.h"
+
+// Defaults match the OpenSSD firmware the glue in extfs_glue.c was written for
+struct Model {
+    unsigned int sectors_per_page; // SECTORS_PER_PAGE
+    unsigned int pages_per_bank; // PAGES_PER_BANK
+    double page_read_us; // NAND page read including the transfer to DRAM
+    double access_us; // CPU time of a single read_disk_* call
+
+    unsigned int cache_slots; // 0 is the single TEMP_BUF_ADDR buffer without page cache
+    unsigned int cache_ways;
+};
+
+struct Result {
+    unsigned long long accesses;
+    unsigned long long lba_changes;
+    unsigned long long page_reads;
+    unsigned int banks;
+    double latency_us;
+};
+
+struct CacheSlot {
+    unsigned int page;
+    unsigned long long last_use;
+};
+
+// Replays the trace like load_lba does: nothing happens while the LBA stays the same, every other LBA either hits
+// the page cache or causes a NAND page read.
+static void replay(struct TraceRecord* records, unsigned int count, struct Model* model, struct Result* result) {
+    const unsigned int ways = (model->cache_ways && model->cache_ways < model->cache_slots) ? model->cache_ways : model->cache_slots;
+    const unsigned int sets = ways ? model->cache_slots / ways : 0;
+
+    struct CacheSlot* slots = calloc(sets * ways + 1, sizeof(struct CacheSlot));
+
+    for (unsigned int i = 0; i < sets * ways; i++) {
+        slots[i].page = -1;
+    }
+
+    unsigned char* banks_used = calloc(65536, 1);
+
+    unsigned int current_lba = -1;
+    unsigned long long tick = 0;
+
+    memset(result, 0, sizeof(struct Result));
+
+    for (unsigned int i = 0; i < count; i++) {
+        const unsigned int first_lba = records[i].offset / SECTOR_SIZE;
+        const unsigned int last_lba = (records[i].offset + records[i].length - 1) / SECTOR_SIZE;
+
+        result->accesses++;
+
+        for (unsigned int lba = first_lba; lba <= last_lba; lba++) {
+            if (lba == current_lba) {
+                continue;
+            }
+
+            current_lba = lba;
+            result->lba_changes++;
+            tick++;
+
+            const unsigned int page = lba / model->sectors_per_page;
+            int hit = 0;
+
+            if (sets) {
+                struct CacheSlot* set = &slots[(page % sets) * ways];
+                struct CacheSlot* victim = &set[0];
+
+                for (unsigned int w = 0; w < ways; w++) {
+                    if (set[w].page == page) {
+                        victim = &set[w];
+                        hit = 1;
+                        break;
+                    }
+
+                    if (set[w].last_use < victim->last_use) {
+                        victim = &set[w];
+                    }
+                }
+
+                victim->page = page;
+                victim->last_use = tick;
+            }
+
+            if (!hit) {
+                const unsigned int bank = (page / model->pages_per_bank) % 65536;
+
+                result->page_reads++;
+
+                if (!banks_used[bank]) {
+                    banks_used[bank] = 1;
+                    result->banks++;
+                }
+            }
+        }
+    }
+
+    result->latency_us = (result->page_reads * model->page_read_us) + (result->accesses * model->access_us);
+
+    free(banks_used);
+    free(slots);
+}
+
+static void print_result(struct Model* model, struct Result* result) {
+    printf("%8u %6u %12llu %12llu %12llu %8u %14.1f\n", model->cache_slots, model->cache_slots ? model->cache_ways : 0,
+           result->accesses, result->lba_changes, result->page_reads, result->banks, result->latency_us);
+}
+
+int main(int argc, char *argv[]) {
+    struct Model model = {
+        .sectors_per_page = 64,
+        .pages_per_bank = 128 * 4096,
+        .page_read_us = 60.0,
+        .access_us = 0.05,
+        .cache_slots = 0,
+        .cache_ways = 1
+    };
+
+    int sweep = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:b:l:a:c:w:")) != -1) {
+        switch (opt) {
+            case 'p':
+                model.sectors_per_page = atoi(optarg);
+                break;
+            case 'b':
+                model.pages_per_bank = atoi(optarg);
+                break;
+            case 'l':
+                model.page_read_us = atof(optarg);
+                break;
+            case 'a':
+                model.access_us = atof(optarg);
+                break;
+            case 'c':
+                model.cache_slots = atoi(optarg);
+                sweep = 0;
+                break;
+            case 'w':
+                model.cache_ways = atoi(optarg);
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+
+    if (argc - optind != 1 || !model.sectors_per_page || !model.pages_per_bank) {
+        printf("%s [-p sectors per page] [-b pages per bank] [-l page read us] [-a access us] [-c cache pages] [-w cache ways] <trace file>\n", argv[0]);
+        printf("Without -c the cache size is swept from 0 to 1024 pages\n");
+        exit(0);
+    }
+
+    FILE* trace = fopen(argv[optind], "r");
+
+    if (trace == NULL) {
+        perror("Can't open trace file");
+        exit(1);
+    }
+
+    unsigned int count = 0;
+    unsigned int capacity = 0;
+    struct TraceRecord* records = NULL;
+
+    unsigned int offset, length;
+    unsigned long long timestamp;
+
+    while (fscanf(trace, "%u %u %llu", &offset, &length, &timestamp) == 3) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            records = realloc(records, capacity * sizeof(struct TraceRecord));
+
+            if (records == NULL) {
+                perror("Can't allocate trace");
+                exit(1);
+            }
+        }
+
+        records[count].offset = offset;
+        records[count].length = length ? length : 1;
+        records[count].timestamp = timestamp;
+        count++;
+    }
+
+    fclose(trace);
+
+    if (!count) {
+        printf("Empty trace\n");
+        return 1;
+    }
+
+    printf("%u accesses, recorded in %.1f us\n", count, (records[count - 1].timestamp - records[0].timestamp) / 1000.0);
+    printf("%8s %6s %12s %12s %12s %8s %14s\n", "slots", "ways", "accesses", "lba changes", "page reads", "banks", "latency (us)");
+
+    struct Result result;
+
+    if (sweep) {
+        for (unsigned int slots = 0; slots <= 1024; slots = slots ? slots * 2 : 1) {
+            model.cache_slots = slots;
+
+            replay(records, count, &model, &result);
+            print_result(&model, &result);
+        }
+    }
+    else {
+        replay(records, count, &model, &result);
+        print_result(&model, &result);
+    }
+
+    free(records);
+
+    return 0;
+}
@@ -0,0 +1,262 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "extfs.h"
+
+struct File {
+    char path[FILE_PATH_SIZE];
+    unsigned int inode_nr;
+};
+
+struct Search {
+    const void* disk_buffer_start;
+    const void* partition_buffer_start;
+
+    struct Superblock* sblock;
+
+    struct SearchPattern* patterns;
+    unsigned int pattern_count;
+    unsigned int max_pattern_length;
+
+    struct File* files;
+    unsigned int file_count;
+    unsigned int file_capacity;
+
+    unsigned int next_file; // Next file to be claimed by a worker
+    unsigned int hits;
+    unsigned int failed; // Files whose block map can't be walked
+
+    pthread_mutex_t lock;
+};
+
+static void add_file(struct Search* search, const char* path, unsigned int inode_nr) {
+    if (search->file_count == search->file_capacity) {
+        search->file_capacity = search->file_capacity ? search->file_capacity * 2 : 1024;
+        search->files = realloc(search->files, search->file_capacity * sizeof(struct File));
+
+        if (search->files == NULL) {
+            perror("Can't allocate file list");
+            exit(1);
+        }
+    }
+
+    strncpy(search->files[search->file_count].path, path, FILE_PATH_SIZE - 1);
+    search->files[search->file_count].path[FILE_PATH_SIZE - 1] = 0;
+    search->files[search->file_count].inode_nr = inode_nr;
+
+    search->file_count++;
+}
+
+static void collect_files(struct Search* search, unsigned int dir_inode_nr, const char* dir_path) {
+    struct Inode dir_inode;
+
+    if (!parse_inode(search->sblock, &dir_inode, dir_inode_nr) || dir_inode.filetype != FILETYPE_DIR) {
+        return;
+    }
+
+    char file_name[FILE_PATH_SIZE];
+    unsigned int file_inode_nr;
+
+    unsigned int de_p = 0;
+    while (get_inode_dirent(search->sblock, &dir_inode, file_name, &file_inode_nr, &de_p)) {
+        if (strcmp(file_name, ".") == 0 || strcmp(file_name, "..") == 0) {
+            continue;
+        }
+
+        char file_path[FILE_PATH_SIZE];
+        if (snprintf(file_path, FILE_PATH_SIZE, "%s/%s", dir_path, file_name) >= FILE_PATH_SIZE) {
+            continue;
+        }
+
+        struct Inode inode;
+        if (!parse_inode(search->sblock, &inode, file_inode_nr)) {
+            continue;
+        }
+
+        if (inode.filetype == FILETYPE_DIR) {
+            collect_files(search, file_inode_nr, file_path);
+        }
+        else if ((inode.mode & 0xF000) == 0x8000 && !(inode.flags & (0x80000 | 0x10000000))) { // Regular files with a block map only
+            add_file(search, file_path, file_inode_nr);
+        }
+    }
+}
+
+struct Hit {
+    struct Search* search;
+    struct File* file;
+};
+
+static void report_hit(void* ctx, unsigned int offset, unsigned int pattern_nr) {
+    struct Hit* hit = ctx;
+
+    pthread_mutex_lock(&hit->search->lock);
+    printf("%s:%u: %.*s\n", hit->file->path, offset, hit->search->patterns[pattern_nr].length, hit->search->patterns[pattern_nr].data);
+    pthread_mutex_unlock(&hit->search->lock);
+}
+
+static void* search_worker(void* arg) {
+    struct Search* search = arg;
+
+    // The buffer pointers are thread local
+    __g_disk_buffer_start = search->disk_buffer_start;
+    __g_partition_buffer_start = search->partition_buffer_start;
+
+    uint8_t* buffer = malloc(search->sblock->block_size + search->max_pattern_length);
+
+    if (buffer == NULL) {
+        perror("Can't allocate search buffer");
+        exit(1);
+    }
+
+    unsigned int hits = 0;
+    unsigned int failed = 0;
+
+    for (;;) {
+        const unsigned int file_nr = __atomic_fetch_add(&search->next_file, 1, __ATOMIC_RELAXED);
+
+        if (file_nr >= search->file_count) {
+            break;
+        }
+
+        struct Hit hit = { search, &search->files[file_nr] };
+        struct Inode inode;
+
+        if (parse_inode(search->sblock, &inode, hit.file->inode_nr)) {
+            const int file_hits = search_inode_content(search->sblock, &inode, search->patterns, search->pattern_count, buffer, report_hit, &hit);
+
+            if (file_hits < 0) {
+                fprintf(stderr, "%s: can't be searched completely\n", hit.file->path);
+                failed++;
+            }
+            else {
+                hits += file_hits;
+            }
+        }
+    }
+
+    __atomic_fetch_add(&search->hits, hits, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&search->failed, failed, __ATOMIC_RELAXED);
+
+    free(buffer);
+
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("%s <image file> <pattern> [pattern ...]\n", argv[0]);
+        exit(0);
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+
+    if (fd == -1) {
+        perror("Can't open file");
+        exit(1);
+    }
+
+    struct stat img_stat_info;
+
+    if (fstat(fd, &img_stat_info) == -1) {
+        perror("Can't stat file");
+        exit(1);
+    }
+
+    __g_disk_buffer_start = mmap(NULL, img_stat_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (__g_disk_buffer_start == MAP_FAILED) {
+        perror("Can't map file");
+        exit(1);
+    }
+
+    close(fd);
+
+    struct Partition first_partition_info;
+    if (!parse_partition(&first_partition_info, 0))  {
+        printf("MBR corrupt or partition not used\n");
+        return 0;
+    }
+
+    __g_partition_buffer_start = __g_disk_buffer_start + first_partition_info.start_sector * SECTOR_SIZE;
+
+    struct Superblock sblock;
+    if (!parse_superblock(&sblock, 0))  {
+        printf("superblock corrupt\n");
+        return 0;
+    }
+
+    struct Search search = {0};
+    search.disk_buffer_start = __g_disk_buffer_start;
+    search.partition_buffer_start = __g_partition_buffer_start;
+    search.sblock = &sblock;
+    search.pattern_count = argc - 2;
+    search.patterns = calloc(search.pattern_count, sizeof(struct SearchPattern));
+    pthread_mutex_init(&search.lock, NULL);
+
+    for (unsigned int i = 0; i < search.pattern_count; i++) {
+        search.patterns[i].data = argv[i + 2];
+        search.patterns[i].length = strlen(argv[i + 2]);
+
+        if (search.patterns[i].length > search.max_pattern_length) {
+            search.max_pattern_length = search.patterns[i].length;
+        }
+    }
+
+    collect_files(&search, ROOT_DIR_INODE, "");
+
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+
+    pthread_t threads[thread_count];
+
+    for (long i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, search_worker, &search);
+    }
+
+    for (long i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    fprintf(stderr, "%u files searched, %u hits, %u failed\n", search.file_count, search.hits, search.failed);
+
+    return search.failed ? 2 : (search.hits ? 0 : 1);
+}
@@ -0,0 +1,99 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "extfs.h"
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        printf("%s <image file>\n", argv[0]);
+        exit(0);
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+
+    if (fd == -1) {
+        perror("Can't open file");
+        exit(1);
+    }
+
+    struct stat img_stat_info;
+
+    if (fstat(fd, &img_stat_info) == -1) {
+        perror("Can't stat file");
+        exit(1);
+    }
+
+    __g_disk_buffer_start = mmap(NULL, img_stat_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (__g_disk_buffer_start == MAP_FAILED) {
+        perror("Can't map file");
+        exit(1);
+    }
+
+    close(fd);
+
+    struct Partition first_partition_info;
+    if (!parse_partition(&first_partition_info, 0))  {
+        printf("MBR corrupt or partition not used\n");
+        return 0;
+    }
+
+    __g_partition_buffer_start = __g_disk_buffer_start + first_partition_info.start_sector * SECTOR_SIZE;
+
+    struct Superblock sblock;
+    if (!parse_superblock(&sblock, 0))  {
+        printf("superblock corrupt\n");
+        return 0;
+    }
+
+    struct BlockgroupUsage* bg_usage = calloc(sblock.bg_count, sizeof(struct BlockgroupUsage));
+    struct FsUsage usage;
+
+    int consistent = get_fs_usage(&sblock, &usage, bg_usage);
+
+    for (unsigned int bg_nr = 0; bg_nr < sblock.bg_count; bg_nr++) {
+        if (bg_usage[bg_nr].free_block_count != bg_usage[bg_nr].desc_free_block_count) {
+            print_bg_usage(&bg_usage[bg_nr]);
+        }
+    }
+
+    print_fs_usage(&usage);
+
+    free(bg_usage);
+
+    return consistent ? 0 : 2;
+}
@@ -43,8 +43,19 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define FILE_PATH_SIZE 256
 
+// Define as _Thread_local to give every thread its own mounted image and caches
+#ifndef LLEXTFS_THREAD_LOCAL
+    #define LLEXTFS_THREAD_LOCAL
+#endif
+
 #define ROOT_DIR_INODE 2
 
+#define BG_INODE_UNINIT 0x1
+#define BG_BLOCK_UNINIT 0x2
+
+#define ARENA_ALIGNMENT 8
+#define DENTRY_NAME_SIZE 24
+
 struct Partition {
     unsigned int start_sector;
     unsigned int total_sectors;
@@ -55,6 +66,8 @@ struct Superblock {
 
     unsigned int inode_count; //0x0
     unsigned int block_count; //0x4
+    unsigned int free_block_count; //0xC
+    unsigned int free_inode_count; //0x10
     unsigned int block_size; //0x18 2^(10+block_size) = actual block size
     unsigned int first_data_block; //0x14
     unsigned int blocks_per_group; //0x20
@@ -62,6 +75,7 @@ struct Superblock {
     unsigned short signature; //0x38
     unsigned int first_non_res_inode; //0x54
     unsigned short inode_size;
+    unsigned int feature_incompat; //0x60
     unsigned int feature_ro_compat;
 
     // Calculated:
@@ -70,12 +84,42 @@ struct Superblock {
     unsigned int bg_desc_size;
 };
 
+struct MountState {
+    unsigned int from_backup; // The primary superblock was damaged
+
+    // Cursor of check_backup_superblocks
+    unsigned int next_bg_nr;
+    unsigned int bad_backup_count;
+};
+
 struct Blockgroup {
     unsigned int bg_nr;
 
     unsigned int inode_table_block_nr;
     unsigned int block_bitmap_block_nr;
     unsigned int inode_bitmap_block_nr;
+    unsigned int free_block_count;
+    unsigned int free_inode_count;
+    unsigned short flags;
+};
+
+struct BlockgroupUsage {
+    unsigned int bg_nr;
+
+    unsigned int block_count;
+    unsigned int used_block_count; // From the block bitmap
+    unsigned int free_block_count; // From the block bitmap
+    unsigned int desc_free_block_count; // From the descriptor
+};
+
+struct FsUsage {
+    unsigned int block_count;
+    unsigned int used_block_count;
+    unsigned int free_block_count;
+    unsigned int desc_free_block_count; // Sum of all descriptors
+    unsigned int sb_free_block_count;
+
+    unsigned int bg_mismatch_count; // Groups where the bitmap and descriptor disagree
 };
 
 struct Inode {
@@ -94,52 +138,180 @@ struct Inode {
     unsigned int blockmap[15];
 };
 
-extern unsigned int __g_partition_offset;
+struct InodeBatch {
+    unsigned int count;
+
+    // Columns, a NULL column is skipped
+    unsigned int* inode_nr;
+    unsigned short* mode;
+    unsigned short* uid;
+    unsigned int* size;
+    unsigned int* flags;
+    unsigned int* block_count;
+};
+
+struct SearchPattern {
+    const char* data;
+    unsigned int length;
+};
+
+typedef void (*search_hit_callback)(void* ctx, unsigned int offset, unsigned int pattern_nr);
+
+struct Arena {
+    uint8_t* base;
+    size_t size;
+    size_t used;
+};
+
+struct CacheBudget {
+    size_t page_cache;
+    size_t bg_desc_cache;
+    size_t dentry_cache;
+};
+
+struct Dentry {
+    unsigned int dir_inode_nr;
+    unsigned int inode_nr;
+    char name[DENTRY_NAME_SIZE];
+};
+
+struct Caches {
+    struct Arena page_cache;
+    struct Arena bg_desc_cache;
+    struct Arena dentry_cache;
+
+    struct Blockgroup* bg_descs;
+    unsigned int bg_desc_slots;
+
+    struct Dentry* dentries;
+    unsigned int dentry_slots;
+};
+
+extern LLEXTFS_THREAD_LOCAL struct Caches __g_caches;
+
+struct Backend {
+    void* ctx;
+
+    // Returns 1 on success, reads past the end of the image return zeros
+    int (*read)(void* ctx, uint64_t offset, void* buffer, unsigned int length);
+    void (*close)(void* ctx);
+};
+
+// Offsets on the disk, the backends can read images past 4 GB
+#ifdef LLEXTFS_USE_BACKEND
+    typedef uint64_t disk_offset_t;
+#else
+    typedef unsigned int disk_offset_t;
+#endif
+
+extern LLEXTFS_THREAD_LOCAL disk_offset_t __g_partition_offset;
 
 #ifndef llextfs_printf
     #include <stdio.h>
     #define llextfs_printf printf
 #endif
 
-#ifdef LLEXTFS_USE_GLUE
+struct TraceRecord {
+    uint32_t offset; // On the disk
+    uint32_t length;
+    uint64_t timestamp;
+};
+
+#ifdef LLEXTFS_TRACE
+    void start_trace(struct TraceRecord records[], unsigned int capacity);
+    unsigned int stop_trace(unsigned int* dropped);
+    void trace_access(unsigned int offset, unsigned int length);
+
+    #define TRACE_ACCESS(offset, length) trace_access(offset, length)
+#else
+    #define TRACE_ACCESS(offset, length) ((void) 0)
+#endif
+
+#if defined(LLEXTFS_USE_GLUE) || defined(LLEXTFS_USE_BACKEND)
     void reset_extfs();
 
-    uint8_t read_disk_uint8(unsigned int offset);
-    uint16_t read_disk_uint16(unsigned int offset);
-    uint32_t read_disk_uint32(unsigned int offset);
+    uint8_t read_disk_uint8(disk_offset_t offset);
+    uint16_t read_disk_uint16(disk_offset_t offset);
+    uint32_t read_disk_uint32(disk_offset_t offset);
+
+    uint8_t read_partition_uint8(disk_offset_t offset);
+    uint16_t read_partition_uint16(disk_offset_t offset);
+    uint32_t read_partition_uint32(disk_offset_t offset);
+
+    void read_partition_bytes(disk_offset_t offset, void* buffer, unsigned int length);
+
+    #ifdef LLEXTFS_USE_BACKEND
+        #define BACKEND_BUFFER_SIZE 4096
+        #define FRAME_CACHE_SLOTS 8
 
-    uint8_t read_partition_uint8(unsigned int offset);
-    uint16_t read_partition_uint16(unsigned int offset);
-    uint32_t read_partition_uint32(unsigned int offset);
+        void set_backend(struct Backend* backend);
+        void close_backend(struct Backend* backend);
+
+        int open_file_backend(struct Backend* backend, const char* file_name);
+        int open_zstd_seekable_backend(struct Backend* backend, const char* file_name);
+        int open_gzip_indexed_backend(struct Backend* backend, const char* file_name, const char* index_file_name);
+        int open_android_sparse_backend(struct Backend* backend, const char* file_name);
+        int open_qcow2_backend(struct Backend* backend, const char* file_name);
+
+        int build_gzip_index(const char* file_name, const char* index_file_name, unsigned int span);
+    #endif
 #else
-    #define reset_extfs()
+    #define reset_extfs() reset_extfs_caches()
+
+    extern LLEXTFS_THREAD_LOCAL const void* __g_disk_buffer_start;
+    extern LLEXTFS_THREAD_LOCAL const void* __g_partition_buffer_start;
 
-    const void* __g_disk_buffer_start;
-    const void* __g_partition_buffer_start;
+    #define TRACE_PARTITION_ACCESS(offset, length) TRACE_ACCESS((__g_partition_buffer_start - __g_disk_buffer_start) + (offset), length)
 
-    #define read_disk_uint8(offset) (*(uint8_t *) (__g_disk_buffer_start + offset))
-    #define read_disk_uint16(offset) (*(uint16_t *) (__g_disk_buffer_start + offset))
-    #define read_disk_uint32(offset) (*(uint32_t *) (__g_disk_buffer_start + offset))
+    #define read_disk_uint8(offset) (TRACE_ACCESS(offset, 1), *(uint8_t *) (__g_disk_buffer_start + offset))
+    #define read_disk_uint16(offset) (TRACE_ACCESS(offset, 2), *(uint16_t *) (__g_disk_buffer_start + offset))
+    #define read_disk_uint32(offset) (TRACE_ACCESS(offset, 4), *(uint32_t *) (__g_disk_buffer_start + offset))
 
-    #define read_partition_uint8(offset) (*(uint8_t *) (__g_partition_buffer_start + offset))
-    #define read_partition_uint16(offset) (*(uint16_t *) (__g_partition_buffer_start + offset))
-    #define read_partition_uint32(offset) (*(uint32_t *) (__g_partition_buffer_start + offset))
+    #define read_partition_uint8(offset) (TRACE_PARTITION_ACCESS(offset, 1), *(uint8_t *) (__g_partition_buffer_start + offset))
+    #define read_partition_uint16(offset) (TRACE_PARTITION_ACCESS(offset, 2), *(uint16_t *) (__g_partition_buffer_start + offset))
+    #define read_partition_uint32(offset) (TRACE_PARTITION_ACCESS(offset, 4), *(uint32_t *) (__g_partition_buffer_start + offset))
+
+    #define read_partition_bytes(offset, buffer, length) (TRACE_PARTITION_ACCESS(offset, length), memcpy(buffer, __g_partition_buffer_start + (offset), length))
 #endif
 
+void arena_init(struct Arena* arena, void* buffer, size_t size);
+void* arena_alloc(struct Arena* arena, size_t size);
+void arena_reset(struct Arena* arena);
+
+int init_extfs_caches(void* buffer, size_t size, struct CacheBudget* budget);
+void reset_extfs_caches();
+
+int get_cached_bg_descriptor(struct Blockgroup* bg_descriptor, unsigned int bg_nr);
+void cache_bg_descriptor(struct Blockgroup* bg_descriptor);
+int get_cached_dentry(unsigned int dir_inode_nr, char file_name[], unsigned int* file_inode_nr);
+void cache_dentry(unsigned int dir_inode_nr, char file_name[], unsigned int file_inode_nr);
+
 int parse_partition(struct Partition* partition, unsigned int partion_nr);
 int parse_superblock(struct Superblock* sblock, unsigned int sb_nr);
+int is_superblock_backup_group(struct Superblock* sblock, unsigned int bg_nr);
+int mount_extfs(struct Superblock* sblock, struct MountState* state, unsigned int partition_sectors);
+int check_backup_superblocks(struct Superblock* sblock, struct MountState* state, unsigned int max_checks);
 void parse_bg_descriptor(struct Superblock* sblock, struct Blockgroup* bg_descriptor, unsigned int bg_nr);
 int parse_inode(struct Superblock* sblock, struct Inode* inode, unsigned int inode_nr);
 
+int parse_inode_table_block(struct Superblock* sblock, struct InodeBatch* batch, unsigned int bg_nr, unsigned int table_block_nr);
+
+int get_bg_usage(struct Superblock* sblock, struct BlockgroupUsage* usage, unsigned int bg_nr);
+int get_fs_usage(struct Superblock* sblock, struct FsUsage* usage, struct BlockgroupUsage bg_usage[]);
+
 int get_inode_data_block(struct Superblock* sblock, struct Inode *inode, unsigned int db_nr, unsigned int* db_block_nr);
 int get_inode_dirent(struct Superblock *sblock, struct Inode *inode, char file_name[], unsigned int* file_inode_nr, unsigned int *de_p);
 int get_inode_for_file_name_in_inode(struct Superblock* sblock, struct Inode* inode, char file_path[], unsigned int* file_inode_nr);
 int get_inode_for_path(struct Superblock* sblock, char file_path[], unsigned int* file_inode_nr);
 
+int search_inode_content(struct Superblock* sblock, struct Inode* inode, struct SearchPattern patterns[], unsigned int pattern_count, uint8_t* buffer, search_hit_callback callback, void* ctx);
+
 void print_partition_metadata(struct Partition *layout);
 void print_superblock_metadata(struct Superblock *sblock);
 void print_parsed_bg_descriptor(struct Blockgroup* bg_descriptor);
 void print_inode_metadata(struct Inode *inode);
+void print_bg_usage(struct BlockgroupUsage* usage);
+void print_fs_usage(struct FsUsage* usage);
 
 void dump_data_block(struct Superblock* sblock, unsigned int db_nr);
 void dump_inode_content(struct Superblock* sblock, struct Inode* inode);
@@ -30,6 +30,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "extfs.h"
 
+#if !defined(LLEXTFS_USE_GLUE) && !defined(LLEXTFS_USE_BACKEND)
+LLEXTFS_THREAD_LOCAL const void* __g_disk_buffer_start;
+LLEXTFS_THREAD_LOCAL const void* __g_partition_buffer_start;
+#endif
+
 // Simple replacement as the embedded environment didn't provide a pow implementation
 inline static int _pow(int x, int y) {
     int v = x;
@@ -56,8 +61,26 @@ int parse_partition(struct Partition* partition, unsigned int partion_nr) {
     return 1;
 }
 
+inline static int _is_power_of(unsigned int n, unsigned int p) {
+    if (n == 0) {
+        return 0;
+    }
+
+    while (n % p == 0) {
+        n /= p;
+    }
+
+    return n == 1;
+}
+
+inline static uint64_t _superblock_offset(struct Superblock* sblock, unsigned int sb_nr) {
+    // A backup is at the start of the first block of its group, for 1024 byte blocks that is block 1
+    return (sb_nr > 0) ? (((uint64_t) sb_nr * sblock->bg_size) + (sblock->first_data_block ? 1024 : 0)) : 1024;
+}
+
+// The geometry of sblock is used to locate a backup superblock (sb_nr > 0)
 int parse_superblock(struct Superblock* sblock, unsigned int sb_nr) {
-    const unsigned int sb_buffer_offset = (sb_nr > 0) ? ((sb_nr * sblock->bg_size) + 1024) : 1024;
+    const uint64_t sb_buffer_offset = _superblock_offset(sblock, sb_nr);
 
     if (read_partition_uint16(sb_buffer_offset + 0x38) != 0xEF53) { // Magic signature
         return 0;
@@ -67,6 +90,8 @@ int parse_superblock(struct Superblock* sblock, unsigned int sb_nr) {
 
     sblock->inode_count = read_partition_uint32(sb_buffer_offset); //0x0
     sblock->block_count = read_partition_uint32(sb_buffer_offset + 4);//0x4
+    sblock->free_block_count = read_partition_uint32(sb_buffer_offset + 12);//0xC
+    sblock->free_inode_count = read_partition_uint32(sb_buffer_offset + 16);//0x10
     sblock->first_data_block = read_partition_uint32(sb_buffer_offset + 20); //0x14
     sblock->block_size = (unsigned int) _pow(2, (10 + read_partition_uint16(sb_buffer_offset + 24)));//0x18 2^(10+block_size) = actual block size
     sblock->blocks_per_group = read_partition_uint32(sb_buffer_offset + 32); //0x20
@@ -74,17 +99,169 @@ int parse_superblock(struct Superblock* sblock, unsigned int sb_nr) {
     sblock->signature = read_partition_uint16(sb_buffer_offset + 56);
     sblock->first_non_res_inode = read_partition_uint32(sb_buffer_offset + 84); //0x54
     sblock->inode_size = read_partition_uint16(sb_buffer_offset + 88);
+    sblock->feature_incompat = read_partition_uint32(sb_buffer_offset + 0x60);
     sblock->feature_ro_compat = read_partition_uint32(sb_buffer_offset + 0x64);
 
     sblock->bg_count = sblock->block_count / sblock->blocks_per_group + ((sblock->block_count % sblock->blocks_per_group) ? 1 : 0);
     sblock->bg_size = sblock->blocks_per_group * sblock->block_size;
 
-    sblock->bg_desc_size = 32; //for 32b fs
+    if (sblock->feature_incompat & 0x80) { // 64bit
+        if (read_partition_uint32(sb_buffer_offset + 0x150)) { // Block numbers past 2^32 are not supported
+            return 0;
+        }
+
+        sblock->bg_desc_size = read_partition_uint16(sb_buffer_offset + 0xFE);
+
+        if (sblock->bg_desc_size < 64) {
+            return 0;
+        }
+    }
+    else {
+        sblock->bg_desc_size = 32;
+    }
 
     return 1;
 }
 
+int is_superblock_backup_group(struct Superblock* sblock, unsigned int bg_nr) {
+    if (!(sblock->feature_ro_compat & 0x01)) { // Without sparse_super every group has a backup
+        return 1;
+    }
+
+    return bg_nr == 0 || bg_nr == 1 || _is_power_of(bg_nr, 3) || _is_power_of(bg_nr, 5) || _is_power_of(bg_nr, 7);
+}
+
+static uint32_t _crc32c(uint32_t crc, const uint8_t* data, unsigned int length) {
+    for (unsigned int i = 0; i < length; i++) {
+        crc ^= data[i];
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1));
+        }
+    }
+
+    return crc;
+}
+
+static int check_superblock(struct Superblock* sblock) {
+    if (sblock->block_size < 1024 || sblock->block_size > 65536 || !sblock->blocks_per_group || !sblock->inodes_per_group ||
+        sblock->inode_size < 128 || sblock->inode_size > sblock->block_size) {
+        return 0;
+    }
+
+    if (sblock->feature_ro_compat & 0x400) { // metadata_csum, crc32c of everything before s_checksum at 0x3FC
+        const uint64_t sb_buffer_offset = _superblock_offset(sblock, sblock->sb_nr);
+
+        uint8_t buffer[SECTOR_SIZE];
+        uint32_t crc = ~0;
+
+        read_partition_bytes(sb_buffer_offset, buffer, SECTOR_SIZE);
+        crc = _crc32c(crc, buffer, SECTOR_SIZE);
+
+        read_partition_bytes(sb_buffer_offset + SECTOR_SIZE, buffer, 0x3FC - SECTOR_SIZE);
+        crc = _crc32c(crc, buffer, 0x3FC - SECTOR_SIZE);
+
+        if (crc != read_partition_uint32(sb_buffer_offset + 0x3FC)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int check_bg_descriptors(struct Superblock* sblock) {
+    const unsigned int table_blocks = ((sblock->inodes_per_group * sblock->inode_size) + sblock->block_size - 1) / sblock->block_size;
+
+    for (unsigned int bg_nr = 0; bg_nr < sblock->bg_count; bg_nr++) {
+        struct Blockgroup bg;
+        parse_bg_descriptor(sblock, &bg, bg_nr);
+
+        if (bg.block_bitmap_block_nr >= sblock->block_count || bg.inode_bitmap_block_nr >= sblock->block_count ||
+            bg.inode_table_block_nr + table_blocks > sblock->block_count) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// The descriptors are only read once the whole file system is known to fit in the partition
+static int check_fits_partition(struct Superblock* sblock, unsigned int partition_sectors) {
+#ifdef LLEXTFS_USE_GLUE
+    // The glue reads with 32 bit offsets
+    if ((uint64_t) __g_partition_offset + ((uint64_t) sblock->block_count * sblock->block_size) > 0x100000000ULL) {
+        llextfs_printf("File system ends past 4 GB, not supported");
+        return 0;
+    }
+#endif
+
+    return (uint64_t) sblock->block_count * sblock->block_size <= (uint64_t) partition_sectors * SECTOR_SIZE && check_bg_descriptors(sblock);
+}
+
+// Validates the primary superblock and the block group descriptors only, the backups can be checked later with
+// check_backup_superblocks. When the primary superblock is damaged the backup in group 1 is used instead, its
+// location is guessed from the default geometry for every block size that fits in the partition.
+int mount_extfs(struct Superblock* sblock, struct MountState* state, unsigned int partition_sectors) {
+    state->from_backup = 0;
+    state->next_bg_nr = 1;
+    state->bad_backup_count = 0;
+
+    if (parse_superblock(sblock, 0) && check_superblock(sblock)) {
+        return check_fits_partition(sblock, partition_sectors);
+    }
+
+    for (unsigned int block_size = 1024; block_size <= 16384; block_size *= 2) {
+        struct Superblock backup_sblock;
+
+        backup_sblock.block_size = block_size;
+        backup_sblock.blocks_per_group = 8 * block_size;
+        backup_sblock.bg_size = backup_sblock.blocks_per_group * block_size;
+        backup_sblock.first_data_block = (block_size == 1024) ? 1 : 0;
+
+        if ((_superblock_offset(&backup_sblock, 1) / SECTOR_SIZE) + (1024 / SECTOR_SIZE) > partition_sectors) {
+            break;
+        }
+
+        if (parse_superblock(&backup_sblock, 1) && check_superblock(&backup_sblock)) {
+            *sblock = backup_sblock;
+            state->from_backup = 1;
+
+            return check_fits_partition(sblock, partition_sectors);
+        }
+    }
+
+    return 0;
+}
+
+// Checks at most max_checks backup superblocks, starting where the previous call stopped. This spreads the work
+// over idle time instead of the mount. Returns 1 once every backup has been checked.
+int check_backup_superblocks(struct Superblock* sblock, struct MountState* state, unsigned int max_checks) {
+    while (state->next_bg_nr < sblock->bg_count && max_checks) {
+        const unsigned int bg_nr = state->next_bg_nr++;
+
+        if (!is_superblock_backup_group(sblock, bg_nr)) {
+            continue;
+        }
+
+        max_checks--;
+
+        struct Superblock backup_sblock = *sblock;
+
+        if (!parse_superblock(&backup_sblock, bg_nr) || !check_superblock(&backup_sblock) ||
+            backup_sblock.block_size != sblock->block_size || backup_sblock.blocks_per_group != sblock->blocks_per_group ||
+            backup_sblock.inodes_per_group != sblock->inodes_per_group || backup_sblock.inode_count != sblock->inode_count) {
+            state->bad_backup_count++;
+        }
+    }
+
+    return state->next_bg_nr >= sblock->bg_count;
+}
+
 void parse_bg_descriptor(struct Superblock* sblock, struct Blockgroup* bg_descriptor, unsigned int bg_nr) {
+    if (get_cached_bg_descriptor(bg_descriptor, bg_nr)) {
+        return;
+    }
+
     const unsigned int bg_buffer_offset = (sblock->block_size <= 1024 ? 2 * sblock->block_size : sblock->block_size) + (bg_nr * sblock->bg_desc_size);
 
     bg_descriptor->bg_nr = bg_nr;
@@ -92,6 +269,16 @@ void parse_bg_descriptor(struct Superblock* sblock, struct Blockgroup* bg_descri
     bg_descriptor->inode_table_block_nr = read_partition_uint32(bg_buffer_offset + 8);
     bg_descriptor->block_bitmap_block_nr = read_partition_uint32(bg_buffer_offset + 0);
     bg_descriptor->inode_bitmap_block_nr = read_partition_uint32(bg_buffer_offset + 4);
+    bg_descriptor->free_block_count = read_partition_uint16(bg_buffer_offset + 12);
+    bg_descriptor->free_inode_count = read_partition_uint16(bg_buffer_offset + 14);
+    bg_descriptor->flags = read_partition_uint16(bg_buffer_offset + 18);
+
+    if (sblock->bg_desc_size >= 64) { // The high halves of the free counts
+        bg_descriptor->free_block_count |= read_partition_uint16(bg_buffer_offset + 0x2C) << 16;
+        bg_descriptor->free_inode_count |= read_partition_uint16(bg_buffer_offset + 0x2E) << 16;
+    }
+
+    cache_bg_descriptor(bg_descriptor);
 }
 
 int parse_inode(struct Superblock* sblock, struct Inode* inode, unsigned int inode_nr) {
@@ -101,7 +288,7 @@ int parse_inode(struct Superblock* sblock, struct Inode* inode, unsigned int ino
     struct Blockgroup inode_bg;
     parse_bg_descriptor(sblock, &inode_bg, inode_bg_nr);
 
-    const unsigned int inode_offset = (inode_bg.inode_table_block_nr * sblock->block_size) + (inode_nr_in_bg * sblock->inode_size);
+    const uint64_t inode_offset = ((uint64_t) inode_bg.inode_table_block_nr * sblock->block_size) + (inode_nr_in_bg * sblock->inode_size);
 
     inode->inode_nr = inode_nr;
     inode->mode = read_partition_uint16(inode_offset);
@@ -139,20 +326,129 @@ int parse_inode(struct Superblock* sblock, struct Inode* inode, unsigned int ino
     }
 }
 
-int get_inode_data_block(struct Superblock* sblock, struct Inode *inode, unsigned int db_nr, unsigned int* db_block_nr) {
-    if (db_nr >= 12) { //indirect
+inline static uint16_t _le16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+inline static uint32_t _le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// Decode all inodes in one block of the inode table of a block group. The table is read a sector at a time instead
+// of field by field, the columns of the batch must be able to hold block_size / inode_size entries.
+int parse_inode_table_block(struct Superblock* sblock, struct InodeBatch* batch, unsigned int bg_nr, unsigned int table_block_nr) {
+    const unsigned int inodes_per_block = sblock->block_size / sblock->inode_size;
+    const unsigned int first_inode_in_bg = table_block_nr * inodes_per_block;
+
+    batch->count = 0;
+
+    if (first_inode_in_bg >= sblock->inodes_per_group) {
         return 0;
     }
-    else { //direct
-        if (inode->blockmap[db_nr]) {
-            *db_block_nr = inode->blockmap[db_nr];
 
-            return 1;
+    const unsigned int count = (sblock->inodes_per_group - first_inode_in_bg < inodes_per_block) ? sblock->inodes_per_group - first_inode_in_bg : inodes_per_block;
+
+    struct Blockgroup inode_bg;
+    parse_bg_descriptor(sblock, &inode_bg, bg_nr);
+
+    const uint64_t table_offset = (uint64_t) (inode_bg.inode_table_block_nr + table_block_nr) * sblock->block_size;
+
+    uint8_t buffer[SECTOR_SIZE];
+    const unsigned int inodes_per_read = (sblock->inode_size < SECTOR_SIZE) ? SECTOR_SIZE / sblock->inode_size : 1;
+
+    for (unsigned int i = 0; i < count; i += inodes_per_read) {
+        const unsigned int n = (count - i < inodes_per_read) ? count - i : inodes_per_read;
+
+        read_partition_bytes(table_offset + (i * sblock->inode_size), buffer, (inodes_per_read > 1) ? n * sblock->inode_size : 0x24);
+
+        for (unsigned int j = 0; j < n; j++) {
+            const uint8_t* raw = buffer + (j * sblock->inode_size);
+            const unsigned int k = i + j;
+
+            if (batch->inode_nr) {
+                batch->inode_nr[k] = (bg_nr * sblock->inodes_per_group) + first_inode_in_bg + k + 1;
+            }
+            if (batch->mode) {
+                batch->mode[k] = _le16(raw);
+            }
+            if (batch->uid) {
+                batch->uid[k] = _le16(raw + 2);
+            }
+            if (batch->size) {
+                batch->size[k] = _le32(raw + 4);
+            }
+            if (batch->block_count) {
+                batch->block_count[k] = _le32(raw + 0x1C);
+            }
+            if (batch->flags) {
+                batch->flags[k] = _le32(raw + 0x20);
+            }
         }
-        else {
+    }
+
+    batch->count = count;
+
+    return count;
+}
+
+// Returns 1 when data block db_nr is mapped, 0 for a hole and -1 when the block map can't be walked: extents and
+// inline data have no block map, and block numbers past the end of the file system mean it is corrupt.
+int get_inode_data_block(struct Superblock* sblock, struct Inode *inode, unsigned int db_nr, unsigned int* db_block_nr) {
+    if (inode->flags & (0x80000 | 0x10000000)) {
+        return -1;
+    }
+
+    const unsigned int per_block = sblock->block_size / 4; // Block numbers in an indirect block
+
+    unsigned int block_nr;
+    unsigned int span = 1; // Data blocks covered by one entry of the current indirect block
+    unsigned int levels = 0;
+
+    if (db_nr < 12) { //direct
+        block_nr = inode->blockmap[db_nr];
+    }
+    else if ((db_nr -= 12) < per_block) { //single indirect
+        block_nr = inode->blockmap[12];
+        levels = 1;
+    }
+    else if ((db_nr -= per_block) < per_block * per_block) { //double indirect
+        block_nr = inode->blockmap[13];
+        span = per_block;
+        levels = 2;
+    }
+    else { //triple indirect
+        db_nr -= per_block * per_block;
+        block_nr = inode->blockmap[14];
+        span = per_block * per_block;
+        levels = 3;
+    }
+
+    for (; levels > 0; levels--) {
+        if (block_nr == 0) {
             return 0;
         }
+
+        if (block_nr >= sblock->block_count || db_nr / span >= per_block) {
+            return -1;
+        }
+
+        block_nr = read_partition_uint32(((uint64_t) block_nr * sblock->block_size) + ((db_nr / span) * 4));
+
+        db_nr %= span;
+        span /= per_block;
+    }
+
+    if (block_nr == 0) {
+        return 0;
+    }
+
+    if (block_nr >= sblock->block_count) {
+        return -1;
     }
+
+    *db_block_nr = block_nr;
+
+    return 1;
 }
 
 int get_inode_dirent(struct Superblock *sblock, struct Inode *inode, char file_name[], unsigned int* file_inode_nr, unsigned int *de_p) {
@@ -165,18 +461,20 @@ int get_inode_dirent(struct Superblock *sblock, struct Inode *inode, char file_n
 
     unsigned int db_block_nr;
 
-    if (!get_inode_data_block(sblock, inode, db_nr, &db_block_nr)) {
+    if (get_inode_data_block(sblock, inode, db_nr, &db_block_nr) <= 0) {
         return 0;
     }
 
-    unsigned int ent_inode = read_partition_uint32((db_block_nr * sblock->block_size) + db_offset);
+    const uint64_t de_offset = ((uint64_t) db_block_nr * sblock->block_size) + db_offset;
+
+    unsigned int ent_inode = read_partition_uint32(de_offset);
 
     if (!ent_inode) { // Not in use
         return 0;
     }
 
-    unsigned int ent_length = read_partition_uint16((db_block_nr * sblock->block_size) + db_offset + 4);
-    unsigned short ent_name_length = read_partition_uint16((db_block_nr * sblock->block_size) + db_offset + 6) & 0xFF;
+    unsigned int ent_length = read_partition_uint16(de_offset + 4);
+    unsigned short ent_name_length = read_partition_uint16(de_offset + 6) & 0xFF;
 
     if (!ent_length) { // Corrupt entry?
         return 0;
@@ -184,7 +482,7 @@ int get_inode_dirent(struct Superblock *sblock, struct Inode *inode, char file_n
 
     int p = 0;
     for (; p < ent_name_length; p++) {
-        file_name[p] = read_partition_uint8((db_block_nr * sblock->block_size) + db_offset + 8 + p);
+        file_name[p] = read_partition_uint8(de_offset + 8 + p);
     }
 
     file_name[p] = 0;
@@ -206,6 +504,10 @@ int get_inode_for_file_name_in_inode(struct Superblock* sblock, struct Inode* in
         return 0;
     }
 
+    if (get_cached_dentry(inode->inode_nr, file_name, file_inode_nr)) {
+        return 1;
+    }
+
     char current_file_name[FILE_PATH_SIZE];
     unsigned int current_file_inode_nr;
 
@@ -214,6 +516,8 @@ int get_inode_for_file_name_in_inode(struct Superblock* sblock, struct Inode* in
         if (strncmp(file_name, current_file_name, FILE_PATH_SIZE) == 0) {
             *file_inode_nr = current_file_inode_nr;
 
+            cache_dentry(inode->inode_nr, file_name, current_file_inode_nr);
+
             return 1;
         }
     }
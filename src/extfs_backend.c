@@ -0,0 +1,207 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#ifdef LLEXTFS_USE_BACKEND
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "extfs.h"
+
+LLEXTFS_THREAD_LOCAL disk_offset_t __g_partition_offset = 0;
+
+LLEXTFS_THREAD_LOCAL struct Backend* __g_backend = NULL;
+
+// Last chunk read from the backend, the file system is read a few bytes at a time
+LLEXTFS_THREAD_LOCAL uint8_t __g_backend_buffer[BACKEND_BUFFER_SIZE];
+LLEXTFS_THREAD_LOCAL uint64_t __g_backend_buffer_offset = -1;
+
+void reset_extfs() {
+    __g_partition_offset = 0;
+    __g_backend_buffer_offset = -1;
+
+    reset_extfs_caches();
+}
+
+void set_backend(struct Backend* backend) {
+    __g_backend = backend;
+
+    reset_extfs();
+}
+
+void close_backend(struct Backend* backend) {
+    if (__g_backend == backend) {
+        set_backend(NULL);
+    }
+
+    if (backend->close) {
+        backend->close(backend->ctx);
+    }
+
+    backend->ctx = NULL;
+}
+
+static void read_disk_bytes(disk_offset_t offset, void* buffer, unsigned int length) {
+    uint8_t* p = buffer;
+
+    while (length) {
+        const uint64_t chunk_offset = offset - (offset % BACKEND_BUFFER_SIZE);
+
+        if (chunk_offset != __g_backend_buffer_offset) {
+            if (!__g_backend || !__g_backend->read(__g_backend->ctx, chunk_offset, __g_backend_buffer, BACKEND_BUFFER_SIZE)) {
+                __g_backend_buffer_offset = -1;
+                memset(p, 0, length);
+
+                return;
+            }
+
+            __g_backend_buffer_offset = chunk_offset;
+        }
+
+        const unsigned int chunk_left = BACKEND_BUFFER_SIZE - (offset - chunk_offset);
+        const unsigned int n = (length < chunk_left) ? length : chunk_left;
+
+        memcpy(p, __g_backend_buffer + (offset - chunk_offset), n);
+
+        p += n;
+        offset += n;
+        length -= n;
+    }
+}
+
+uint8_t read_disk_uint8(disk_offset_t offset) {
+    TRACE_ACCESS(offset, 1);
+
+    uint8_t v;
+    read_disk_bytes(offset, &v, 1);
+
+    return v;
+}
+
+uint16_t read_disk_uint16(disk_offset_t offset) {
+    TRACE_ACCESS(offset, 2);
+
+    uint8_t v[2];
+    read_disk_bytes(offset, v, 2);
+
+    return (v[1] << 8) + v[0];
+}
+
+uint32_t read_disk_uint32(disk_offset_t offset) {
+    TRACE_ACCESS(offset, 4);
+
+    uint8_t v[4];
+    read_disk_bytes(offset, v, 4);
+
+    return ((uint32_t) v[3] << 24) + (v[2] << 16) + (v[1] << 8) + v[0];
+}
+
+uint8_t read_partition_uint8(disk_offset_t offset) {
+    return read_disk_uint8(__g_partition_offset + offset);
+}
+
+uint16_t read_partition_uint16(disk_offset_t offset) {
+    return read_disk_uint16(__g_partition_offset + offset);
+}
+
+uint32_t read_partition_uint32(disk_offset_t offset) {
+    return read_disk_uint32(__g_partition_offset + offset);
+}
+
+void read_partition_bytes(disk_offset_t offset, void* buffer, unsigned int length) {
+    TRACE_ACCESS(__g_partition_offset + offset, length);
+
+    read_disk_bytes(__g_partition_offset + offset, buffer, length);
+}
+
+struct FileBackend {
+    int fd;
+    uint64_t size;
+};
+
+static int read_file_backend(void* ctx, uint64_t offset, void* buffer, unsigned int length) {
+    struct FileBackend* file = ctx;
+
+    unsigned int n = 0;
+
+    if (offset < file->size) {
+        const ssize_t ret = pread(file->fd, buffer, (file->size - offset < length) ? file->size - offset : length, offset);
+
+        if (ret < 0) {
+            return 0;
+        }
+
+        n = ret;
+    }
+
+    memset((uint8_t *) buffer + n, 0, length - n);
+
+    return 1;
+}
+
+static void close_file_backend(void* ctx) {
+    struct FileBackend* file = ctx;
+
+    close(file->fd);
+    free(file);
+}
+
+int open_file_backend(struct Backend* backend, const char* file_name) {
+    struct FileBackend* file = malloc(sizeof(struct FileBackend));
+
+    if (file == NULL) {
+        return 0;
+    }
+
+    struct stat file_stat_info;
+
+    file->fd = open(file_name, O_RDONLY);
+
+    if (file->fd == -1 || fstat(file->fd, &file_stat_info) == -1) {
+        if (file->fd != -1) {
+            close(file->fd);
+        }
+
+        free(file);
+        return 0;
+    }
+
+    file->size = file_stat_info.st_size;
+
+    backend->ctx = file;
+    backend->read = read_file_backend;
+    backend->close = close_file_backend;
+
+    return 1;
+}
+
+#endif
@@ -0,0 +1,572 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#ifdef LLEXTFS_USE_BACKEND
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+#include <zstd.h>
+
+#include "extfs.h"
+
+#define ZSTD_SKIPPABLE_MAGIC 0x184D2A5E
+#define ZSTD_SEEKABLE_MAGIC 0x8F92EAB1
+#define ZSTD_SEEK_TABLE_FOOTER_SIZE 9
+
+#define GZIP_INDEX_MAGIC "LLGZIDX1"
+#define GZIP_WINDOW_SIZE 32768
+#define GZIP_CHUNK_SIZE 16384
+
+struct CachedFrame {
+    unsigned int frame_nr;
+    uint8_t* data;
+    size_t capacity;
+    uint64_t last_use;
+};
+
+// Where raw deflate decompression can be restarted, see zlib's examples/zran.c
+struct AccessPoint {
+    uint8_t bits;
+    uint8_t* window; // zlib compressed
+    unsigned int window_length;
+};
+
+// An image split in independently decompressible frames. The frames that were used last are kept decompressed.
+struct CompressedImage {
+    int fd;
+
+    unsigned int frame_count;
+    uint64_t* in_offsets; // frame_count + 1 entries
+    uint64_t* out_offsets; // frame_count + 1 entries
+
+    int (*decompress)(struct CompressedImage* image, unsigned int frame_nr, uint8_t* out, size_t length);
+
+    ZSTD_DCtx* dctx;
+    uint8_t* input;
+    size_t input_capacity;
+
+    struct AccessPoint* points;
+
+    struct CachedFrame frames[FRAME_CACHE_SLOTS];
+    uint64_t tick;
+};
+
+static uint32_t _le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static int pread_full(int fd, void* buffer, size_t length, uint64_t offset) {
+    uint8_t* p = buffer;
+
+    while (length) {
+        const ssize_t n = pread(fd, p, length, offset);
+
+        if (n <= 0) {
+            return 0;
+        }
+
+        p += n;
+        offset += n;
+        length -= n;
+    }
+
+    return 1;
+}
+
+static struct CompressedImage* alloc_compressed_image(int fd, unsigned int frame_count) {
+    struct CompressedImage* image = calloc(1, sizeof(struct CompressedImage));
+
+    if (image == NULL) {
+        return NULL;
+    }
+
+    image->fd = fd;
+    image->frame_count = frame_count;
+    image->in_offsets = calloc(frame_count + 1, sizeof(uint64_t));
+    image->out_offsets = calloc(frame_count + 1, sizeof(uint64_t));
+
+    for (int i = 0; i < FRAME_CACHE_SLOTS; i++) {
+        image->frames[i].frame_nr = -1;
+    }
+
+    return image;
+}
+
+static void close_compressed_image(void* ctx) {
+    struct CompressedImage* image = ctx;
+
+    for (int i = 0; i < FRAME_CACHE_SLOTS; i++) {
+        free(image->frames[i].data);
+    }
+
+    if (image->points) {
+        for (unsigned int i = 0; i < image->frame_count; i++) {
+            free(image->points[i].window);
+        }
+
+        free(image->points);
+    }
+
+    if (image->dctx) {
+        ZSTD_freeDCtx(image->dctx);
+    }
+
+    free(image->input);
+    free(image->in_offsets);
+    free(image->out_offsets);
+
+    close(image->fd);
+    free(image);
+}
+
+static struct CachedFrame* get_frame(struct CompressedImage* image, unsigned int frame_nr) {
+    struct CachedFrame* victim = &image->frames[0];
+
+    image->tick++;
+
+    for (int i = 0; i < FRAME_CACHE_SLOTS; i++) {
+        if (image->frames[i].frame_nr == frame_nr) {
+            image->frames[i].last_use = image->tick;
+
+            return &image->frames[i];
+        }
+
+        if (image->frames[i].last_use < victim->last_use) {
+            victim = &image->frames[i];
+        }
+    }
+
+    const size_t length = image->out_offsets[frame_nr + 1] - image->out_offsets[frame_nr];
+
+    if (victim->capacity < length) {
+        uint8_t* data = realloc(victim->data, length);
+
+        if (data == NULL) {
+            return NULL;
+        }
+
+        victim->data = data;
+        victim->capacity = length;
+    }
+
+    victim->frame_nr = -1;
+
+    if (!image->decompress(image, frame_nr, victim->data, length)) {
+        return NULL;
+    }
+
+    victim->frame_nr = frame_nr;
+    victim->last_use = image->tick;
+
+    return victim;
+}
+
+static int read_compressed_image(void* ctx, uint64_t offset, void* buffer, unsigned int length) {
+    struct CompressedImage* image = ctx;
+    uint8_t* p = buffer;
+
+    while (length) {
+        if (offset >= image->out_offsets[image->frame_count]) {
+            memset(p, 0, length);
+            break;
+        }
+
+        // Last frame starting at or before offset
+        unsigned int lo = 0;
+        unsigned int hi = image->frame_count - 1;
+
+        while (lo < hi) {
+            const unsigned int mid = lo + (hi - lo + 1) / 2;
+
+            if (image->out_offsets[mid] <= offset) {
+                lo = mid;
+            }
+            else {
+                hi = mid - 1;
+            }
+        }
+
+        struct CachedFrame* frame = get_frame(image, lo);
+
+        if (frame == NULL) {
+            return 0;
+        }
+
+        const uint64_t frame_offset = offset - image->out_offsets[lo];
+        const uint64_t frame_left = image->out_offsets[lo + 1] - offset;
+        const unsigned int n = (length < frame_left) ? length : frame_left;
+
+        memcpy(p, frame->data + frame_offset, n);
+
+        p += n;
+        offset += n;
+        length -= n;
+    }
+
+    return 1;
+}
+
+static int decompress_zstd_frame(struct CompressedImage* image, unsigned int frame_nr, uint8_t* out, size_t length) {
+    const size_t compressed_length = image->in_offsets[frame_nr + 1] - image->in_offsets[frame_nr];
+
+    if (image->input_capacity < compressed_length) {
+        uint8_t* input = realloc(image->input, compressed_length);
+
+        if (input == NULL) {
+            return 0;
+        }
+
+        image->input = input;
+        image->input_capacity = compressed_length;
+    }
+
+    if (!pread_full(image->fd, image->input, compressed_length, image->in_offsets[frame_nr])) {
+        return 0;
+    }
+
+    return ZSTD_decompressDCtx(image->dctx, out, length, image->input, compressed_length) == length;
+}
+
+// The seek table of the zstd seekable format is a skippable frame at the end of the file that lists the compressed
+// and decompressed size of every frame.
+int open_zstd_seekable_backend(struct Backend* backend, const char* file_name) {
+    int fd = open(file_name, O_RDONLY);
+
+    if (fd == -1) {
+        return 0;
+    }
+
+    struct stat file_stat_info;
+    uint8_t footer[ZSTD_SEEK_TABLE_FOOTER_SIZE];
+
+    if (fstat(fd, &file_stat_info) == -1 || file_stat_info.st_size < ZSTD_SEEK_TABLE_FOOTER_SIZE + 8 ||
+        !pread_full(fd, footer, ZSTD_SEEK_TABLE_FOOTER_SIZE, file_stat_info.st_size - ZSTD_SEEK_TABLE_FOOTER_SIZE) ||
+        _le32(footer + 5) != ZSTD_SEEKABLE_MAGIC) {
+        close(fd);
+        return 0;
+    }
+
+    const unsigned int frame_count = _le32(footer);
+    const unsigned int entry_size = (footer[4] & 0x80) ? 12 : 8; // Checksum flag
+    const uint64_t table_size = (uint64_t) frame_count * entry_size;
+
+    if (table_size + ZSTD_SEEK_TABLE_FOOTER_SIZE + 8 > (uint64_t) file_stat_info.st_size) {
+        close(fd);
+        return 0;
+    }
+
+    const uint64_t table_offset = file_stat_info.st_size - ZSTD_SEEK_TABLE_FOOTER_SIZE - table_size;
+    uint8_t* table = malloc(table_size + 8);
+
+    if (table == NULL || !pread_full(fd, table, table_size + 8, table_offset - 8) ||
+        _le32(table) != ZSTD_SKIPPABLE_MAGIC || _le32(table + 4) != table_size + ZSTD_SEEK_TABLE_FOOTER_SIZE) {
+        free(table);
+        close(fd);
+        return 0;
+    }
+
+    struct CompressedImage* image = alloc_compressed_image(fd, frame_count);
+
+    if (image == NULL) {
+        free(table);
+        close(fd);
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < frame_count; i++) {
+        image->in_offsets[i + 1] = image->in_offsets[i] + _le32(table + 8 + (i * entry_size));
+        image->out_offsets[i + 1] = image->out_offsets[i] + _le32(table + 8 + (i * entry_size) + 4);
+    }
+
+    free(table);
+
+    image->decompress = decompress_zstd_frame;
+    image->dctx = ZSTD_createDCtx();
+
+    if (!frame_count || image->dctx == NULL) {
+        close_compressed_image(image);
+        return 0;
+    }
+
+    backend->ctx = image;
+    backend->read = read_compressed_image;
+    backend->close = close_compressed_image;
+
+    return 1;
+}
+
+static int decompress_gzip_frame(struct CompressedImage* image, unsigned int frame_nr, uint8_t* out, size_t length) {
+    struct AccessPoint* point = &image->points[frame_nr];
+
+    uint8_t window[GZIP_WINDOW_SIZE];
+    uLongf window_length = GZIP_WINDOW_SIZE;
+
+    if (uncompress(window, &window_length, point->window, point->window_length) != Z_OK) {
+        return 0;
+    }
+
+    z_stream strm = {0};
+
+    if (inflateInit2(&strm, -15) != Z_OK) { // Raw deflate, the point is somewhere inside the stream
+        return 0;
+    }
+
+    uint64_t in_offset = image->in_offsets[frame_nr];
+
+    if (point->bits) {
+        uint8_t byte;
+
+        if (!pread_full(image->fd, &byte, 1, in_offset - 1)) {
+            inflateEnd(&strm);
+            return 0;
+        }
+
+        inflatePrime(&strm, point->bits, byte >> (8 - point->bits));
+    }
+
+    inflateSetDictionary(&strm, window, window_length);
+
+    uint8_t input[GZIP_CHUNK_SIZE];
+    int ret = Z_OK;
+
+    strm.next_out = out;
+    strm.avail_out = length;
+
+    while (strm.avail_out && ret == Z_OK) {
+        if (!strm.avail_in) {
+            const ssize_t n = pread(image->fd, input, GZIP_CHUNK_SIZE, in_offset);
+
+            if (n <= 0) {
+                break;
+            }
+
+            in_offset += n;
+
+            strm.next_in = input;
+            strm.avail_in = n;
+        }
+
+        ret = inflate(&strm, Z_NO_FLUSH);
+    }
+
+    inflateEnd(&strm);
+
+    return strm.avail_out == 0;
+}
+
+int open_gzip_indexed_backend(struct Backend* backend, const char* file_name, const char* index_file_name) {
+    FILE* index = fopen(index_file_name, "rb");
+
+    if (index == NULL) {
+        return 0;
+    }
+
+    char magic[8];
+    uint32_t point_count;
+    uint64_t total_out;
+
+    if (fread(magic, 8, 1, index) != 1 || memcmp(magic, GZIP_INDEX_MAGIC, 8) != 0 ||
+        fread(&point_count, sizeof(uint32_t), 1, index) != 1 || fread(&total_out, sizeof(uint64_t), 1, index) != 1 || !point_count) {
+        fclose(index);
+        return 0;
+    }
+
+    int fd = open(file_name, O_RDONLY);
+
+    if (fd == -1) {
+        fclose(index);
+        return 0;
+    }
+
+    struct CompressedImage* image = alloc_compressed_image(fd, point_count);
+
+    if (image == NULL) {
+        close(fd);
+        fclose(index);
+        return 0;
+    }
+
+    image->decompress = decompress_gzip_frame;
+    image->points = calloc(point_count, sizeof(struct AccessPoint));
+
+    int ok = image->points != NULL;
+
+    for (unsigned int i = 0; ok && i < point_count; i++) {
+        struct AccessPoint* point = &image->points[i];
+        uint32_t window_length;
+
+        ok = fread(&image->out_offsets[i], sizeof(uint64_t), 1, index) == 1 &&
+             fread(&image->in_offsets[i], sizeof(uint64_t), 1, index) == 1 &&
+             fread(&point->bits, 1, 1, index) == 1 &&
+             fread(&window_length, sizeof(uint32_t), 1, index) == 1 &&
+             (point->window = malloc(window_length)) != NULL &&
+             fread(point->window, window_length, 1, index) == 1;
+
+        point->window_length = window_length;
+    }
+
+    fclose(index);
+
+    image->out_offsets[point_count] = total_out;
+
+    if (!ok) {
+        close_compressed_image(image);
+        return 0;
+    }
+
+    backend->ctx = image;
+    backend->read = read_compressed_image;
+    backend->close = close_compressed_image;
+
+    return 1;
+}
+
+static int write_access_point(FILE* index, uint64_t out, uint64_t in, int bits, const uint8_t* window, unsigned int left) {
+    uint8_t last_output[GZIP_WINDOW_SIZE];
+
+    // The window is circular, left is the number of bytes not yet overwritten since the last wrap around
+    if (left) {
+        memcpy(last_output, window + GZIP_WINDOW_SIZE - left, left);
+    }
+
+    if (left < GZIP_WINDOW_SIZE) {
+        memcpy(last_output + left, window, GZIP_WINDOW_SIZE - left);
+    }
+
+    uint8_t compressed[GZIP_WINDOW_SIZE + GZIP_WINDOW_SIZE / 8 + 64];
+    uLongf compressed_length = sizeof(compressed);
+
+    if (compress2(compressed, &compressed_length, last_output, GZIP_WINDOW_SIZE, Z_BEST_SPEED) != Z_OK) {
+        return 0;
+    }
+
+    const uint8_t point_bits = bits;
+    const uint32_t window_length = compressed_length;
+
+    return fwrite(&out, sizeof(uint64_t), 1, index) == 1 && fwrite(&in, sizeof(uint64_t), 1, index) == 1 &&
+           fwrite(&point_bits, 1, 1, index) == 1 && fwrite(&window_length, sizeof(uint32_t), 1, index) == 1 &&
+           fwrite(compressed, compressed_length, 1, index) == 1;
+}
+
+// Decompress the whole file once and write an access point about every span bytes of output. Like zran.c only
+// single member gzip files are supported.
+int build_gzip_index(const char* file_name, const char* index_file_name, unsigned int span) {
+    FILE* in = fopen(file_name, "rb");
+    FILE* index = fopen(index_file_name, "wb");
+
+    if (in == NULL || index == NULL) {
+        if (in) fclose(in);
+        if (index) fclose(index);
+        return 0;
+    }
+
+    uint32_t point_count = 0;
+    uint64_t total_out = 0;
+
+    // Header is rewritten with the final counts
+    fwrite(GZIP_INDEX_MAGIC, 8, 1, index);
+    fwrite(&point_count, sizeof(uint32_t), 1, index);
+    fwrite(&total_out, sizeof(uint64_t), 1, index);
+
+    z_stream strm = {0};
+
+    if (inflateInit2(&strm, 47) != Z_OK) { // Skip the gzip header
+        fclose(in);
+        fclose(index);
+        return 0;
+    }
+
+    static uint8_t input[GZIP_CHUNK_SIZE];
+    static uint8_t window[GZIP_WINDOW_SIZE];
+    memset(window, 0, GZIP_WINDOW_SIZE);
+
+    uint64_t total_in = 0;
+    uint64_t last = 0;
+    int ret = Z_OK;
+    int ok = 1;
+
+    do {
+        strm.avail_in = fread(input, 1, GZIP_CHUNK_SIZE, in);
+        strm.next_in = input;
+
+        if (!strm.avail_in) {
+            ok = 0; // Truncated
+            break;
+        }
+
+        do {
+            if (!strm.avail_out) {
+                strm.avail_out = GZIP_WINDOW_SIZE;
+                strm.next_out = window;
+            }
+
+            total_in += strm.avail_in;
+            total_out += strm.avail_out;
+
+            ret = inflate(&strm, Z_BLOCK);
+
+            total_in -= strm.avail_in;
+            total_out -= strm.avail_out;
+
+            if (ret != Z_OK && ret != Z_STREAM_END) {
+                ok = 0;
+                break;
+            }
+
+            // At the end of a deflate block, but not the last one
+            if (ret != Z_STREAM_END && (strm.data_type & 128) && !(strm.data_type & 64) && (point_count == 0 || total_out - last > span)) {
+                if (!write_access_point(index, total_out, total_in, strm.data_type & 7, window, strm.avail_out)) {
+                    ok = 0;
+                    break;
+                }
+
+                point_count++;
+                last = total_out;
+            }
+        } while (strm.avail_in && ret != Z_STREAM_END);
+    } while (ok && ret != Z_STREAM_END);
+
+    inflateEnd(&strm);
+    fclose(in);
+
+    if (ok) {
+        fseek(index, 8, SEEK_SET);
+        ok = fwrite(&point_count, sizeof(uint32_t), 1, index) == 1 && fwrite(&total_out, sizeof(uint64_t), 1, index) == 1;
+    }
+
+    return (fclose(index) == 0) && ok;
+}
+
+#endif
@@ -0,0 +1,380 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#ifdef LLEXTFS_USE_BACKEND
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "extfs.h"
+
+#define SPARSE_MAGIC 0xED26FF3A
+#define SPARSE_CHUNK_RAW 0xCAC1
+#define SPARSE_CHUNK_FILL 0xCAC2
+#define SPARSE_CHUNK_DONT_CARE 0xCAC3
+#define SPARSE_CHUNK_CRC32 0xCAC4
+
+#define QCOW2_MAGIC 0x514649FB
+#define QCOW2_OFFSET_MASK 0x00FFFFFFFFFFFE00ULL
+#define QCOW2_COMPRESSED (1ULL << 62)
+#define QCOW2_ZERO 1ULL
+
+#define EXTENT_DATA 0
+#define EXTENT_FILL 1
+
+// A range of the image that is stored in the file. Everything not covered by an extent reads as zeros.
+struct Extent {
+    uint64_t out_offset;
+    uint64_t length;
+    uint64_t in_offset;
+    uint32_t fill;
+    uint32_t type;
+};
+
+struct SparseImage {
+    int fd;
+
+    struct Extent* extents; // Sorted on out_offset
+    unsigned int extent_count;
+    unsigned int extent_capacity;
+};
+
+static uint16_t _le16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t _le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint32_t _be32(const uint8_t* p) {
+    return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64_t _be64(const uint8_t* p) {
+    return ((uint64_t) _be32(p) << 32) | _be32(p + 4);
+}
+
+static int pread_full(int fd, void* buffer, size_t length, uint64_t offset) {
+    uint8_t* p = buffer;
+
+    while (length) {
+        const ssize_t n = pread(fd, p, length, offset);
+
+        if (n <= 0) {
+            return 0;
+        }
+
+        p += n;
+        offset += n;
+        length -= n;
+    }
+
+    return 1;
+}
+
+static int add_extent(struct SparseImage* image, uint64_t out_offset, uint64_t length, uint64_t in_offset, uint32_t type, uint32_t fill) {
+    if (image->extent_count) {
+        struct Extent* last = &image->extents[image->extent_count - 1];
+
+        // Merge with the previous extent when both are contiguous
+        if (last->type == type && last->out_offset + last->length == out_offset &&
+            ((type == EXTENT_DATA && last->in_offset + last->length == in_offset) || (type == EXTENT_FILL && last->fill == fill))) {
+            last->length += length;
+            return 1;
+        }
+    }
+
+    if (image->extent_count == image->extent_capacity) {
+        image->extent_capacity = image->extent_capacity ? image->extent_capacity * 2 : 256;
+
+        struct Extent* extents = realloc(image->extents, image->extent_capacity * sizeof(struct Extent));
+
+        if (extents == NULL) {
+            return 0;
+        }
+
+        image->extents = extents;
+    }
+
+    struct Extent* extent = &image->extents[image->extent_count++];
+
+    extent->out_offset = out_offset;
+    extent->length = length;
+    extent->in_offset = in_offset;
+    extent->type = type;
+    extent->fill = fill;
+
+    return 1;
+}
+
+static int read_sparse_image(void* ctx, uint64_t offset, void* buffer, unsigned int length) {
+    struct SparseImage* image = ctx;
+    uint8_t* p = buffer;
+
+    // First extent ending after offset
+    unsigned int lo = 0;
+    unsigned int hi = image->extent_count;
+
+    while (lo < hi) {
+        const unsigned int mid = lo + (hi - lo) / 2;
+
+        if (image->extents[mid].out_offset + image->extents[mid].length <= offset) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    while (length) {
+        if (lo == image->extent_count) {
+            memset(p, 0, length);
+            break;
+        }
+
+        struct Extent* extent = &image->extents[lo];
+
+        if (offset < extent->out_offset) { // Hole before the extent
+            const unsigned int n = (extent->out_offset - offset < length) ? extent->out_offset - offset : length;
+
+            memset(p, 0, n);
+
+            p += n;
+            offset += n;
+            length -= n;
+
+            continue;
+        }
+
+        const uint64_t extent_left = extent->out_offset + extent->length - offset;
+        const unsigned int n = (extent_left < length) ? extent_left : length;
+
+        if (extent->type == EXTENT_DATA) {
+            if (!pread_full(image->fd, p, n, extent->in_offset + (offset - extent->out_offset))) {
+                return 0;
+            }
+        }
+        else {
+            for (unsigned int i = 0; i < n; i++) {
+                p[i] = extent->fill >> (8 * ((offset + i - extent->out_offset) % 4));
+            }
+        }
+
+        p += n;
+        offset += n;
+        length -= n;
+
+        lo++;
+    }
+
+    return 1;
+}
+
+static void close_sparse_image(void* ctx) {
+    struct SparseImage* image = ctx;
+
+    close(image->fd);
+    free(image->extents);
+    free(image);
+}
+
+static struct SparseImage* alloc_sparse_image(const char* file_name) {
+    struct SparseImage* image = calloc(1, sizeof(struct SparseImage));
+
+    if (image == NULL) {
+        return NULL;
+    }
+
+    image->fd = open(file_name, O_RDONLY);
+
+    if (image->fd == -1) {
+        free(image);
+        return NULL;
+    }
+
+    return image;
+}
+
+// Android sparse images are a list of chunks, RAW chunks hold data, FILL chunks repeat a 32 bit value and DONT_CARE
+// chunks are left out of the index so they read as zeros.
+int open_android_sparse_backend(struct Backend* backend, const char* file_name) {
+    struct SparseImage* image = alloc_sparse_image(file_name);
+
+    if (image == NULL) {
+        return 0;
+    }
+
+    uint8_t header[28];
+
+    if (!pread_full(image->fd, header, 28, 0) || _le32(header) != SPARSE_MAGIC || _le16(header + 4) != 1) {
+        close_sparse_image(image);
+        return 0;
+    }
+
+    const unsigned int file_header_size = _le16(header + 8);
+    const unsigned int chunk_header_size = _le16(header + 10);
+    const unsigned int block_size = _le32(header + 12);
+    const unsigned int chunk_count = _le32(header + 20);
+
+    uint64_t in_offset = file_header_size;
+    uint64_t out_offset = 0;
+
+    for (unsigned int i = 0; i < chunk_count; i++) {
+        uint8_t chunk[12];
+        uint8_t fill[4];
+
+        if (chunk_header_size < 12 || !pread_full(image->fd, chunk, 12, in_offset)) {
+            close_sparse_image(image);
+            return 0;
+        }
+
+        const unsigned int type = _le16(chunk);
+        const uint64_t length = (uint64_t) _le32(chunk + 4) * block_size;
+        const uint64_t data_offset = in_offset + chunk_header_size;
+
+        int ok = 1;
+
+        switch (type) {
+            case SPARSE_CHUNK_RAW:
+                ok = add_extent(image, out_offset, length, data_offset, EXTENT_DATA, 0);
+                break;
+            case SPARSE_CHUNK_FILL:
+                ok = pread_full(image->fd, fill, 4, data_offset);
+
+                if (ok && _le32(fill)) {
+                    ok = add_extent(image, out_offset, length, 0, EXTENT_FILL, _le32(fill));
+                }
+                break;
+            case SPARSE_CHUNK_DONT_CARE:
+            case SPARSE_CHUNK_CRC32:
+                break;
+            default:
+                ok = 0;
+                break;
+        }
+
+        if (!ok) {
+            close_sparse_image(image);
+            return 0;
+        }
+
+        in_offset += _le32(chunk + 8);
+        out_offset += length;
+    }
+
+    backend->ctx = image;
+    backend->read = read_sparse_image;
+    backend->close = close_sparse_image;
+
+    return 1;
+}
+
+// Only standalone, unencrypted images without compressed clusters are supported. The L1 and L2 tables are read
+// once, runs of clusters that are contiguous in the file become a single extent.
+int open_qcow2_backend(struct Backend* backend, const char* file_name) {
+    struct SparseImage* image = alloc_sparse_image(file_name);
+
+    if (image == NULL) {
+        return 0;
+    }
+
+    uint8_t header[80];
+
+    if (!pread_full(image->fd, header, 72, 0) || _be32(header) != QCOW2_MAGIC) {
+        close_sparse_image(image);
+        return 0;
+    }
+
+    const unsigned int version = _be32(header + 4);
+    const uint64_t backing_file_offset = _be64(header + 8);
+    const unsigned int cluster_bits = _be32(header + 20);
+    const unsigned int crypt_method = _be32(header + 32);
+    const unsigned int l1_size = _be32(header + 36);
+    const uint64_t l1_table_offset = _be64(header + 40);
+
+    if ((version != 2 && version != 3) || backing_file_offset || crypt_method || cluster_bits < 9 || cluster_bits > 21) {
+        close_sparse_image(image);
+        return 0;
+    }
+
+    if (version == 3 && (!pread_full(image->fd, header + 72, 8, 72) || (_be64(header + 72) & ~1ULL))) { // Only the dirty bit
+        close_sparse_image(image);
+        return 0;
+    }
+
+    const uint64_t cluster_size = 1ULL << cluster_bits;
+    const unsigned int l2_entries = cluster_size / 8;
+
+    uint8_t* l1_table = malloc((size_t) l1_size * 8);
+    uint8_t* l2_table = malloc(cluster_size);
+
+    int ok = l1_table && l2_table && pread_full(image->fd, l1_table, (size_t) l1_size * 8, l1_table_offset);
+
+    for (unsigned int i = 0; ok && i < l1_size; i++) {
+        const uint64_t l2_table_offset = _be64(l1_table + (i * 8)) & QCOW2_OFFSET_MASK;
+
+        if (!l2_table_offset) { // Unallocated, reads as zeros
+            continue;
+        }
+
+        ok = pread_full(image->fd, l2_table, cluster_size, l2_table_offset);
+
+        for (unsigned int j = 0; ok && j < l2_entries; j++) {
+            const uint64_t entry = _be64(l2_table + (j * 8));
+            const uint64_t cluster_offset = entry & QCOW2_OFFSET_MASK;
+
+            if (entry & QCOW2_COMPRESSED) {
+                ok = 0;
+            }
+            else if (cluster_offset && !(entry & QCOW2_ZERO)) {
+                ok = add_extent(image, (((uint64_t) i * l2_entries) + j) * cluster_size, cluster_size, cluster_offset, EXTENT_DATA, 0);
+            }
+        }
+    }
+
+    free(l1_table);
+    free(l2_table);
+
+    if (!ok) {
+        close_sparse_image(image);
+        return 0;
+    }
+
+    backend->ctx = image;
+    backend->read = read_sparse_image;
+    backend->close = close_sparse_image;
+
+    return 1;
+}
+
+#endif
@@ -0,0 +1,194 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#include "extfs.h"
+
+LLEXTFS_THREAD_LOCAL struct Caches __g_caches;
+
+// The start of the buffer is aligned, so allocations are aligned when all sizes are a multiple of ARENA_ALIGNMENT
+void arena_init(struct Arena* arena, void* buffer, size_t size) {
+    const size_t padding = (ARENA_ALIGNMENT - ((uintptr_t) buffer % ARENA_ALIGNMENT)) % ARENA_ALIGNMENT;
+
+    arena->base = (uint8_t *) buffer + padding;
+    arena->size = (buffer && size > padding) ? size - padding : 0;
+    arena->used = 0;
+}
+
+void* arena_alloc(struct Arena* arena, size_t size) {
+    const size_t start = (arena->used + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+
+    if (start > arena->size || size > arena->size - start) {
+        return NULL;
+    }
+
+    arena->used = start + size;
+
+    return arena->base + start;
+}
+
+void arena_reset(struct Arena* arena) {
+    arena->used = 0;
+}
+
+// Splits the caller provided buffer in a fixed region per cache. A cache with a budget of 0 is disabled. Nothing is
+// allocated until a cache is used for the first time, so changing the mounted file system only costs a reset.
+int init_extfs_caches(void* buffer, size_t size, struct CacheBudget* budget) {
+    if (budget->page_cache > size || budget->bg_desc_cache > size - budget->page_cache || budget->dentry_cache > size - budget->page_cache - budget->bg_desc_cache) {
+        return 0;
+    }
+
+    uint8_t* p = buffer;
+
+    arena_init(&__g_caches.page_cache, p, budget->page_cache);
+    p += budget->page_cache;
+
+    arena_init(&__g_caches.bg_desc_cache, p, budget->bg_desc_cache);
+    p += budget->bg_desc_cache;
+
+    arena_init(&__g_caches.dentry_cache, p, budget->dentry_cache);
+
+    reset_extfs_caches();
+
+    return 1;
+}
+
+void reset_extfs_caches() {
+    arena_reset(&__g_caches.page_cache);
+    arena_reset(&__g_caches.bg_desc_cache);
+    arena_reset(&__g_caches.dentry_cache);
+
+    __g_caches.bg_descs = NULL;
+    __g_caches.bg_desc_slots = 0;
+
+    __g_caches.dentries = NULL;
+    __g_caches.dentry_slots = 0;
+}
+
+static int setup_bg_desc_cache() {
+    const unsigned int slots = __g_caches.bg_desc_cache.size / sizeof(struct Blockgroup);
+
+    if (!slots) {
+        return 0;
+    }
+
+    __g_caches.bg_descs = arena_alloc(&__g_caches.bg_desc_cache, slots * sizeof(struct Blockgroup));
+
+    if (!__g_caches.bg_descs) {
+        return 0;
+    }
+
+    memset(__g_caches.bg_descs, 0xFF, slots * sizeof(struct Blockgroup)); // bg_nr -1 marks an empty slot
+    __g_caches.bg_desc_slots = slots;
+
+    return 1;
+}
+
+int get_cached_bg_descriptor(struct Blockgroup* bg_descriptor, unsigned int bg_nr) {
+    if (!__g_caches.bg_descs && !setup_bg_desc_cache()) {
+        return 0;
+    }
+
+    struct Blockgroup* slot = &__g_caches.bg_descs[bg_nr % __g_caches.bg_desc_slots];
+
+    if (slot->bg_nr != bg_nr) {
+        return 0;
+    }
+
+    *bg_descriptor = *slot;
+
+    return 1;
+}
+
+void cache_bg_descriptor(struct Blockgroup* bg_descriptor) {
+    if (!__g_caches.bg_descs) {
+        return;
+    }
+
+    __g_caches.bg_descs[bg_descriptor->bg_nr % __g_caches.bg_desc_slots] = *bg_descriptor;
+}
+
+static int setup_dentry_cache() {
+    const unsigned int slots = __g_caches.dentry_cache.size / sizeof(struct Dentry);
+
+    if (!slots) {
+        return 0;
+    }
+
+    __g_caches.dentries = arena_alloc(&__g_caches.dentry_cache, slots * sizeof(struct Dentry));
+
+    if (!__g_caches.dentries) {
+        return 0;
+    }
+
+    memset(__g_caches.dentries, 0, slots * sizeof(struct Dentry)); // Inode 0 is never used, marks an empty slot
+    __g_caches.dentry_slots = slots;
+
+    return 1;
+}
+
+static struct Dentry* get_dentry_slot(unsigned int dir_inode_nr, char file_name[]) {
+    uint32_t hash = 2166136261u ^ dir_inode_nr; // FNV-1a
+
+    for (int i = 0; file_name[i]; i++) {
+        hash = (hash ^ (uint8_t) file_name[i]) * 16777619u;
+    }
+
+    return &__g_caches.dentries[hash % __g_caches.dentry_slots];
+}
+
+int get_cached_dentry(unsigned int dir_inode_nr, char file_name[], unsigned int* file_inode_nr) {
+    if (!__g_caches.dentries && !setup_dentry_cache()) {
+        return 0;
+    }
+
+    struct Dentry* slot = get_dentry_slot(dir_inode_nr, file_name);
+
+    if (!slot->inode_nr || slot->dir_inode_nr != dir_inode_nr || strncmp(slot->name, file_name, DENTRY_NAME_SIZE) != 0) {
+        return 0;
+    }
+
+    *file_inode_nr = slot->inode_nr;
+
+    return 1;
+}
+
+void cache_dentry(unsigned int dir_inode_nr, char file_name[], unsigned int file_inode_nr) {
+    const size_t length = strlen(file_name);
+
+    if (!__g_caches.dentries || length >= DENTRY_NAME_SIZE) { // Long names are not cached
+        return;
+    }
+
+    struct Dentry* slot = get_dentry_slot(dir_inode_nr, file_name);
+
+    slot->dir_inode_nr = dir_inode_nr;
+    slot->inode_nr = file_inode_nr;
+    memcpy(slot->name, file_name, length + 1);
+}
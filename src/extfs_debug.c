@@ -40,6 +40,8 @@ void print_superblock_metadata(struct Superblock *sblock) {
     llextfs_printf("===================Superblock: %d==================\n", sblock->sb_nr);
     llextfs_printf("inode count: %d\n", sblock->inode_count);
     llextfs_printf("block count: %d\n", sblock->block_count);
+    llextfs_printf("free block count: %d\n", sblock->free_block_count);
+    llextfs_printf("free inode count: %d\n", sblock->free_inode_count);
     llextfs_printf("first data block: %d\n", sblock->first_data_block);
     llextfs_printf("block size: %d\n", sblock->block_size);
     llextfs_printf("blocks per group: %d\n", sblock->blocks_per_group);
@@ -57,6 +59,9 @@ void print_parsed_bg_descriptor(struct Blockgroup* bg_descriptor) {
     llextfs_printf("block bitmap location: %d\n", bg_descriptor->block_bitmap_block_nr);
     llextfs_printf("inode bitmap location: %d\n", bg_descriptor->inode_bitmap_block_nr);
     llextfs_printf("inode table location: %d\n", bg_descriptor->inode_table_block_nr);
+    llextfs_printf("free block count: %d\n", bg_descriptor->free_block_count);
+    llextfs_printf("free inode count: %d\n", bg_descriptor->free_inode_count);
+    llextfs_printf("flags: %d\n", bg_descriptor->flags);
 }
 
 void print_inode_metadata(struct Inode *inode) {
@@ -88,8 +93,38 @@ void print_inode_metadata(struct Inode *inode) {
     }
 }
 
+void print_bg_usage(struct BlockgroupUsage* usage) {
+    llextfs_printf("=================BG Usage: %d=================\n", usage->bg_nr);
+    llextfs_printf("blocks: %u\n", usage->block_count);
+    llextfs_printf("used blocks: %u\n", usage->used_block_count);
+    llextfs_printf("free blocks: %u\n", usage->free_block_count);
+
+    if (usage->free_block_count != usage->desc_free_block_count) {
+        llextfs_printf("descriptor free blocks: %u MISMATCH\n", usage->desc_free_block_count);
+    }
+}
+
+void print_fs_usage(struct FsUsage* usage) {
+    llextfs_printf("===================FS Usage==================\n");
+    llextfs_printf("blocks: %u\n", usage->block_count);
+    llextfs_printf("used blocks: %u\n", usage->used_block_count);
+    llextfs_printf("free blocks: %u\n", usage->free_block_count);
+
+    if (usage->bg_mismatch_count) {
+        llextfs_printf("block groups with mismatching descriptor: %u\n", usage->bg_mismatch_count);
+    }
+
+    if (usage->free_block_count != usage->desc_free_block_count) {
+        llextfs_printf("descriptor free blocks: %u MISMATCH\n", usage->desc_free_block_count);
+    }
+
+    if (usage->free_block_count != usage->sb_free_block_count) {
+        llextfs_printf("superblock free blocks: %u MISMATCH\n", usage->sb_free_block_count);
+    }
+}
+
 void dump_data_block(struct Superblock* sblock, unsigned int db_nr) {
-    const unsigned int db_offset = db_nr * sblock->block_size;
+    const uint64_t db_offset = (uint64_t) db_nr * sblock->block_size;
 
     for (int p = 0; p < sblock->block_size; p++) {
         llextfs_printf("%c", read_partition_uint8(db_offset + p));
@@ -100,7 +135,7 @@ void dump_inode_content(struct Superblock* sblock, struct Inode* inode) {
     unsigned int db_nr = 0;
     unsigned int db_block_nr = 0;
 
-    while (get_inode_data_block(sblock, inode, db_nr++, &db_block_nr)) {
+    while (get_inode_data_block(sblock, inode, db_nr++, &db_block_nr) > 0) {
         dump_data_block(sblock, db_block_nr);
     }
 }
\ No newline at end of file
@@ -39,19 +39,60 @@ embedded device. Modify this to your own needs as required.
 
 #include "firmware.h"
 
-unsigned int __g_partition_offset = 0;
+LLEXTFS_THREAD_LOCAL disk_offset_t __g_partition_offset = 0;
 
 unsigned int g_bd_buffer = 0;
+unsigned int g_bd_page_buffer = TEMP_BUF_ADDR;
 unsigned int g_current_lba = -1;
 
+struct PageSlot {
+	UINT32 phys_page;
+	UINT32 buffer;
+};
+
+struct PageSlot* g_page_slots = NULL;
+unsigned int g_page_slot_count = 0;
+unsigned int g_page_cache_ready = 0;
+
 void reset_extfs() {
 	__g_partition_offset = 0;
 
 	g_current_lba = -1;
+	g_bd_page_buffer = TEMP_BUF_ADDR;
+
+	reset_extfs_caches();
+
+	g_page_slots = NULL;
+	g_page_slot_count = 0;
+	g_page_cache_ready = 0;
 
 	llextfs_printf("BD Buffer: %x", TEMP_BUF_ADDR);
 }
 
+// Divide the page cache budget (see init_extfs_caches) in slots of a full NAND page. Without a budget every page is
+// read into TEMP_BUF_ADDR.
+static void setup_page_cache() {
+	unsigned int slots = __g_caches.page_cache.size / (BYTES_PER_PAGE + sizeof(struct PageSlot));
+
+	g_page_cache_ready = 1;
+	g_page_slots = arena_alloc(&__g_caches.page_cache, slots * sizeof(struct PageSlot));
+
+	if (!g_page_slots) {
+		return;
+	}
+
+	for (unsigned int i = 0; i < slots; i++) {
+		g_page_slots[i].phys_page = 0;
+		g_page_slots[i].buffer = (UINT32) arena_alloc(&__g_caches.page_cache, BYTES_PER_PAGE);
+
+		if (!g_page_slots[i].buffer) { // Lost to alignment
+			slots = i;
+		}
+	}
+
+	g_page_slot_count = slots;
+}
+
 // ftl.c:
 UINT32 get_physical_address(UINT32 const lba, UINT32 const lpage_addr);
 
@@ -66,14 +107,33 @@ int load_lba(unsigned int lba) {
 			return 0;
 		}
 
-		UINT32 bank = phys_page / PAGES_PER_BANK;
-		UINT32 row = phys_page % PAGES_PER_BANK;
+		if (!g_page_cache_ready) {
+			setup_page_cache();
+		}
 
-		llextfs_printf("Load LBA: %i from bank %i row %i sector %i", lba, bank, row, sect_offset);
+		UINT32 page_buffer = TEMP_BUF_ADDR;
+		UINT32 cached = 0;
 
-		nand_page_read(bank, row / PAGES_PER_BLK, row % PAGES_PER_BLK, TEMP_BUF_ADDR);
-		flash_finish();
+		if (g_page_slot_count) {
+			struct PageSlot* slot = &g_page_slots[phys_page % g_page_slot_count];
 
+			page_buffer = slot->buffer;
+			cached = (slot->phys_page == phys_page);
+
+			slot->phys_page = phys_page;
+		}
+
+		if (!cached) {
+			UINT32 bank = phys_page / PAGES_PER_BANK;
+			UINT32 row = phys_page % PAGES_PER_BANK;
+
+			llextfs_printf("Load LBA: %i from bank %i row %i sector %i", lba, bank, row, sect_offset);
+
+			nand_page_read(bank, row / PAGES_PER_BLK, row % PAGES_PER_BLK, page_buffer);
+			flash_finish();
+		}
+
+		g_bd_page_buffer = page_buffer;
 		g_bd_buffer = sect_offset;
 		g_current_lba = lba;
 	}
@@ -81,7 +141,9 @@ int load_lba(unsigned int lba) {
 	return 1;
 }
 
-uint8_t read_disk_uint8(unsigned int offset) {
+uint8_t read_disk_uint8(disk_offset_t offset) {
+	TRACE_ACCESS(offset, 1);
+
 	unsigned int lba = offset / SECTOR_SIZE;
 	unsigned int lba_offset = offset % SECTOR_SIZE;
 	
@@ -89,10 +151,12 @@ uint8_t read_disk_uint8(unsigned int offset) {
 		return 0;
 	}
 
-	return read_dram_8(TEMP_BUF_ADDR + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset);
+	return read_dram_8(g_bd_page_buffer + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset);
 }
 
-uint16_t read_disk_uint16(unsigned int offset) {
+uint16_t read_disk_uint16(disk_offset_t offset) {
+	TRACE_ACCESS(offset, 2);
+
 	unsigned int lba = offset / SECTOR_SIZE;
 	unsigned int lba_offset = offset % SECTOR_SIZE;
 	
@@ -100,11 +164,13 @@ uint16_t read_disk_uint16(unsigned int offset) {
 		return 0;
 	}
 
-	return (read_dram_8(TEMP_BUF_ADDR + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset + 1) << 8) + 
-		   read_dram_8(TEMP_BUF_ADDR + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset);
+	return (read_dram_8(g_bd_page_buffer + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset + 1) << 8) + 
+		   read_dram_8(g_bd_page_buffer + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset);
 }
 
-uint32_t read_disk_uint32(unsigned int offset) {
+uint32_t read_disk_uint32(disk_offset_t offset) {
+	TRACE_ACCESS(offset, 4);
+
 	unsigned int lba = offset / SECTOR_SIZE;
 	unsigned int lba_offset = offset % SECTOR_SIZE;
 	
@@ -112,22 +178,30 @@ uint32_t read_disk_uint32(unsigned int offset) {
 		return 0;
 	}
 
-	return (read_dram_8(TEMP_BUF_ADDR + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset + 3) << 24) + 
-		   (read_dram_8(TEMP_BUF_ADDR + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset + 2) << 16) + 
-		   (read_dram_8(TEMP_BUF_ADDR + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset + 1) << 8) + 
-		   read_dram_8(TEMP_BUF_ADDR + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset);
+	return (read_dram_8(g_bd_page_buffer + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset + 3) << 24) + 
+		   (read_dram_8(g_bd_page_buffer + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset + 2) << 16) + 
+		   (read_dram_8(g_bd_page_buffer + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset + 1) << 8) + 
+		   read_dram_8(g_bd_page_buffer + (g_bd_buffer * BYTES_PER_SECTOR) + lba_offset);
 }
 
-uint8_t read_partition_uint8(unsigned int offset) {
+uint8_t read_partition_uint8(disk_offset_t offset) {
 	return read_disk_uint8(__g_partition_offset + offset);
 }
 
-uint16_t read_partition_uint16(unsigned int offset) {
+uint16_t read_partition_uint16(disk_offset_t offset) {
 	return read_disk_uint16(__g_partition_offset + offset);
 }
 
-uint32_t read_partition_uint32(unsigned int offset) {
+uint32_t read_partition_uint32(disk_offset_t offset) {
 	return read_disk_uint32(__g_partition_offset + offset);
 }
 
+void read_partition_bytes(disk_offset_t offset, void* buffer, unsigned int length) {
+	uint8_t* p = buffer;
+
+	for (unsigned int i = 0; i < length; i++) {
+		p[i] = read_disk_uint8(__g_partition_offset + offset + i);
+	}
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,210 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#include "extfs.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    #include <immintrin.h>
+#endif
+
+// Up to this many distinct first bytes are matched with vector compares, more fall back to a table lookup
+#define SEARCH_VECTOR_FIRST_BYTES 4
+
+// All patterns are matched in a single pass over the data. Positions holding the first byte of any pattern are
+// candidates, only the patterns starting with that byte are verified there.
+struct Matcher {
+    int head[256]; // First pattern starting with a byte, -1 when there is none
+    int* next; // Next pattern with the same first byte
+
+    uint8_t first_bytes[SEARCH_VECTOR_FIRST_BYTES];
+    unsigned int first_byte_count; // Distinct first bytes, only stored up to SEARCH_VECTOR_FIRST_BYTES
+};
+
+static void init_matcher(struct Matcher* matcher, int next[], struct SearchPattern patterns[], unsigned int pattern_count) {
+    matcher->next = next;
+    matcher->first_byte_count = 0;
+
+    for (int i = 0; i < 256; i++) {
+        matcher->head[i] = -1;
+    }
+
+    // Chain in reverse so hits at the same position are reported in pattern order
+    for (int i = pattern_count - 1; i >= 0; i--) {
+        if (patterns[i].length == 0) {
+            continue;
+        }
+
+        const uint8_t first = patterns[i].data[0];
+
+        if (matcher->head[first] == -1) {
+            if (matcher->first_byte_count < SEARCH_VECTOR_FIRST_BYTES) {
+                matcher->first_bytes[matcher->first_byte_count] = first;
+            }
+
+            matcher->first_byte_count++;
+        }
+
+        next[i] = matcher->head[first];
+        matcher->head[first] = i;
+    }
+}
+
+// Returns the first position in data[p..end) holding the first byte of any pattern, or end when there is none
+static unsigned int next_candidate(const struct Matcher* matcher, const uint8_t* data, unsigned int p, unsigned int end) {
+    if (matcher->first_byte_count == 1) {
+        const uint8_t* hit = (p < end) ? memchr(data + p, matcher->first_bytes[0], end - p) : NULL;
+
+        return hit ? (unsigned int) (hit - data) : end;
+    }
+
+#if defined(__AVX2__)
+    if (matcher->first_byte_count <= SEARCH_VECTOR_FIRST_BYTES) {
+        __m256i first_v[SEARCH_VECTOR_FIRST_BYTES];
+
+        for (unsigned int i = 0; i < matcher->first_byte_count; i++) {
+            first_v[i] = _mm256_set1_epi8(matcher->first_bytes[i]);
+        }
+
+        for (; p + 32 <= end; p += 32) {
+            const __m256i block = _mm256_loadu_si256((const __m256i *) (data + p));
+            __m256i eq = _mm256_setzero_si256();
+
+            for (unsigned int i = 0; i < matcher->first_byte_count; i++) {
+                eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(block, first_v[i]));
+            }
+
+            const uint32_t mask = _mm256_movemask_epi8(eq);
+
+            if (mask) {
+                return p + __builtin_ctz(mask);
+            }
+        }
+    }
+#elif defined(__SSE2__)
+    if (matcher->first_byte_count <= SEARCH_VECTOR_FIRST_BYTES) {
+        __m128i first_v[SEARCH_VECTOR_FIRST_BYTES];
+
+        for (unsigned int i = 0; i < matcher->first_byte_count; i++) {
+            first_v[i] = _mm_set1_epi8(matcher->first_bytes[i]);
+        }
+
+        for (; p + 16 <= end; p += 16) {
+            const __m128i block = _mm_loadu_si128((const __m128i *) (data + p));
+            __m128i eq = _mm_setzero_si128();
+
+            for (unsigned int i = 0; i < matcher->first_byte_count; i++) {
+                eq = _mm_or_si128(eq, _mm_cmpeq_epi8(block, first_v[i]));
+            }
+
+            const uint32_t mask = _mm_movemask_epi8(eq);
+
+            if (mask) {
+                return p + __builtin_ctz(mask);
+            }
+        }
+    }
+#endif
+
+    for (; p < end; p++) {
+        if (matcher->head[data[p]] >= 0) {
+            return p;
+        }
+    }
+
+    return end;
+}
+
+// The buffer must be able to hold a data block plus the longest pattern minus one byte. The tail of every block is
+// kept in front of the next one so that matches crossing a block boundary are found as well. Holes are searched as
+// zeros. Returns the number of hits, or -1 when the inode has no block map that can be walked.
+int search_inode_content(struct Superblock* sblock, struct Inode* inode, struct SearchPattern patterns[], unsigned int pattern_count, uint8_t* buffer, search_hit_callback callback, void* ctx) {
+    unsigned int max_length = 0;
+
+    for (unsigned int i = 0; i < pattern_count; i++) {
+        if (patterns[i].length > max_length) {
+            max_length = patterns[i].length;
+        }
+    }
+
+    if (!max_length) {
+        return 0;
+    }
+
+    struct Matcher matcher;
+    int next[pattern_count];
+
+    init_matcher(&matcher, next, patterns, pattern_count);
+
+    int hits = 0;
+    unsigned int carry = 0;
+
+    for (unsigned int db_nr = 0; (uint64_t) db_nr * sblock->block_size < inode->size; db_nr++) {
+        const unsigned int file_offset = db_nr * sblock->block_size;
+        const unsigned int length = (inode->size - file_offset < sblock->block_size) ? inode->size - file_offset : sblock->block_size;
+
+        unsigned int db_block_nr = 0;
+        const int mapped = get_inode_data_block(sblock, inode, db_nr, &db_block_nr);
+
+        if (mapped < 0) {
+            return -1;
+        }
+
+        if (mapped) {
+            read_partition_bytes((uint64_t) db_block_nr * sblock->block_size, buffer + carry, length);
+        }
+        else {
+            memset(buffer + carry, 0, length);
+        }
+
+        const unsigned int total = carry + length;
+
+        for (unsigned int p = next_candidate(&matcher, buffer, 0, total); p < total; p = next_candidate(&matcher, buffer, p + 1, total)) {
+            for (int i = matcher.head[buffer[p]]; i >= 0; i = matcher.next[i]) {
+                const unsigned int n = patterns[i].length;
+
+                // Matches completely within the carried bytes were already reported for the previous block
+                if (p + n > total || p + n <= carry || memcmp(buffer + p, patterns[i].data, n) != 0) {
+                    continue;
+                }
+
+                if (callback) {
+                    callback(ctx, file_offset - carry + p, i);
+                }
+
+                hits++;
+            }
+        }
+
+        carry = (total < max_length - 1) ? total : max_length - 1;
+        memmove(buffer, buffer + total - carry, carry);
+    }
+
+    return hits;
+}
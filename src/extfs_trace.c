@@ -0,0 +1,87 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#ifdef LLEXTFS_TRACE
+
+#include "extfs.h"
+
+#ifndef llextfs_timestamp
+    #include <time.h>
+
+    static uint64_t llextfs_timestamp() {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+    }
+#endif
+
+LLEXTFS_THREAD_LOCAL struct TraceRecord* __g_trace_records = NULL;
+LLEXTFS_THREAD_LOCAL unsigned int __g_trace_capacity = 0;
+LLEXTFS_THREAD_LOCAL unsigned int __g_trace_count = 0;
+LLEXTFS_THREAD_LOCAL unsigned int __g_trace_dropped = 0;
+
+void start_trace(struct TraceRecord records[], unsigned int capacity) {
+    __g_trace_records = records;
+    __g_trace_capacity = capacity;
+    __g_trace_count = 0;
+    __g_trace_dropped = 0;
+}
+
+// Returns the number of recorded accesses, accesses that didn't fit in the buffer are counted in dropped
+unsigned int stop_trace(unsigned int* dropped) {
+    if (dropped) {
+        *dropped = __g_trace_dropped;
+    }
+
+    __g_trace_records = NULL;
+    __g_trace_capacity = 0;
+
+    return __g_trace_count;
+}
+
+void trace_access(unsigned int offset, unsigned int length) {
+    if (!__g_trace_records) {
+        return;
+    }
+
+    if (__g_trace_count == __g_trace_capacity) {
+        __g_trace_dropped++;
+        return;
+    }
+
+    struct TraceRecord* record = &__g_trace_records[__g_trace_count++];
+
+    record->offset = offset;
+    record->length = length;
+    record->timestamp = llextfs_timestamp();
+}
+
+#endif
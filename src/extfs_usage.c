@@ -0,0 +1,159 @@
+/**
+
+llextfs - Ext file system driver for low-level (embedded) systems
+
+Copyright (c) 2015, Martijn Bogaard & Yonne de Bruijn
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+**/
+
+#include "extfs.h"
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+#endif
+
+static unsigned int count_bits(const uint8_t* buffer, unsigned int length) {
+    unsigned int count = 0;
+    unsigned int i = 0;
+
+#if defined(__AVX2__)
+    // Count the bits of every nibble with a table lookup, then sum the bytes per 64 bit lane
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    __m256i acc = _mm256_setzero_si256();
+
+    for (; i + 32 <= length; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (buffer + i));
+        const __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_mask));
+        const __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+    }
+
+    count += _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) + _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+#elif defined(__ARM_NEON)
+    uint64x2_t acc = vdupq_n_u64(0);
+
+    for (; i + 16 <= length; i += 16) {
+        acc = vpadalq_u32(acc, vpaddlq_u16(vpaddlq_u8(vcntq_u8(vld1q_u8(buffer + i)))));
+    }
+
+    count += vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#endif
+
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, buffer + i, 8);
+
+        count += __builtin_popcountll(word);
+    }
+
+    for (; i < length; i++) {
+        count += __builtin_popcount(buffer[i]);
+    }
+
+    return count;
+}
+
+// Count the used blocks of a block group in its block bitmap. Groups flagged BLOCK_UNINIT have no bitmap on disk,
+// for those the free count of the descriptor is used. Returns 0 when the bitmap and descriptor disagree.
+int get_bg_usage(struct Superblock* sblock, struct BlockgroupUsage* usage, unsigned int bg_nr) {
+    struct Blockgroup bg;
+    parse_bg_descriptor(sblock, &bg, bg_nr);
+
+    const unsigned int first_block_nr = sblock->first_data_block + (bg_nr * sblock->blocks_per_group);
+    const unsigned int blocks_left = (sblock->block_count > first_block_nr) ? sblock->block_count - first_block_nr : 0;
+
+    usage->bg_nr = bg_nr;
+    usage->block_count = (blocks_left < sblock->blocks_per_group) ? blocks_left : sblock->blocks_per_group;
+    usage->desc_free_block_count = bg.free_block_count;
+
+    if ((bg.flags & BG_BLOCK_UNINIT) && (sblock->feature_ro_compat & (0x10 | 0x400))) { // uninit_bg or metadata_csum
+        usage->free_block_count = (bg.free_block_count < usage->block_count) ? bg.free_block_count : usage->block_count;
+        usage->used_block_count = usage->block_count - usage->free_block_count;
+
+        return 1;
+    }
+
+    uint8_t buffer[SECTOR_SIZE];
+    const uint64_t bitmap_offset = (uint64_t) bg.block_bitmap_block_nr * sblock->block_size;
+    const unsigned int bitmap_length = usage->block_count / 8;
+
+    unsigned int used = 0;
+
+    for (unsigned int p = 0; p < bitmap_length; p += SECTOR_SIZE) {
+        const unsigned int length = (bitmap_length - p < SECTOR_SIZE) ? bitmap_length - p : SECTOR_SIZE;
+
+        read_partition_bytes(bitmap_offset + p, buffer, length);
+        used += count_bits(buffer, length);
+    }
+
+    if (usage->block_count % 8) { // Bits past the last block of the file system are padding
+        used += __builtin_popcount(read_partition_uint8(bitmap_offset + bitmap_length) & ((1 << (usage->block_count % 8)) - 1));
+    }
+
+    usage->used_block_count = used;
+    usage->free_block_count = usage->block_count - used;
+
+    return usage->free_block_count == usage->desc_free_block_count;
+}
+
+// Accumulate the usage of all block groups and compare it to the descriptors and the superblock. bg_usage is
+// optional and receives the usage of every group when given. Returns 0 when any of the counts disagree.
+int get_fs_usage(struct Superblock* sblock, struct FsUsage* usage, struct BlockgroupUsage bg_usage[]) {
+    memset(usage, 0, sizeof(struct FsUsage));
+
+    usage->sb_free_block_count = sblock->free_block_count;
+
+#ifdef LLEXTFS_USE_GLUE
+    // The glue reads with 32 bit offsets, the bitmaps past 4 GB can't be reached
+    if ((uint64_t) sblock->block_count * sblock->block_size > 0x100000000ULL) {
+        llextfs_printf("File system larger than 4 GB, space usage not supported\n");
+        return 0;
+    }
+#endif
+
+    for (unsigned int bg_nr = 0; bg_nr < sblock->bg_count; bg_nr++) {
+        struct BlockgroupUsage current;
+
+        if (!get_bg_usage(sblock, &current, bg_nr)) {
+            usage->bg_mismatch_count++;
+        }
+
+        usage->block_count += current.block_count;
+        usage->used_block_count += current.used_block_count;
+        usage->free_block_count += current.free_block_count;
+        usage->desc_free_block_count += current.desc_free_block_count;
+
+        if (bg_usage) {
+            bg_usage[bg_nr] = current;
+        }
+    }
+
+    return !usage->bg_mismatch_count && usage->free_block_count == usage->desc_free_block_count && usage->free_block_count == usage->sb_free_block_count;
+}